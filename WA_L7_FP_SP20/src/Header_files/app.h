@@ -21,20 +21,47 @@
 		#define	LETIMER0_OUT0_EN	false							/**< set to true for LED0 to blink, false for off **/
 		#define	LETIMER0_ROUTE_OUT1	0								/**< Routing for  LETIMER ROUTE OUT1 (unused) **/
 		#define	LETIMER0_OUT1_EN	false							/**< unused, ignore value **/
+	// Soft Timer Setup
+		#define SAMPLE_TIMER		0								/**< Soft timer ID for the Si7021 sample period **/
+		#define BLE_AT_TIMER		1								/**< Soft timer ID for the HM-10 AT response timeouts **/
+		#define SI7021_TIMER		2								/**< Soft timer ID for the Si7021 conversion wait **/
+		#define HM10_LINK_TIMER		3								/**< Soft timer ID for the HM-10 STATE pin settle time **/
+		#define SAMPLE_PER_MS		3000							/**< Si7021 sample period in milliseconds, after a cold boot **/
+		#define SAMPLE_PER_MIN_MS	100								/**< shortest sample period APP_CMD_RATE accepts **/
+		#define SAMPLE_PER_MAX_MS	3600000							/**< longest sample period APP_CMD_RATE accepts **/
+		#define HIBERNATE_MIN_MS	30000							/**< hibernate (EM4H) between samples if the period is at least this long, BLE commands are not received while hibernating **/
+	// BLE Setup
+		#define BLE_MOD_NAME		"WA-PG12"						/**< name the HM-10 advertises, set by ble_configure() with BLE_AT_CONFIG_ENABLED **/
+		#define HM10_LINK_SETTLE_MS	1200							/**< STATE must stay high this long to count as connected, longer than the 1 s blink of an unconfigured HM-10 **/
 	// I2C Definitions
-		#define TEMP_THRESHOLD		85.0							/**< Temperature Threshold, to either turn on or off LED1 as with the scheduled_i2c_si7021_evt() **/
-	// Scheduler Event IDs
+		#define TEMP_THRESHOLD		8500							/**< Temperature Threshold in hundredths of a degree Fahrenheit after a cold boot, to either turn on or off LED1 as with the scheduled_i2c_si7021_evt() **/
+	// Sample Log
+		#define APP_LOG_SIZE		128								/**< bytes in the sample log ring, 2 per raw Si7021 reading, MUST BE POWER OF 2 **/
+	// Scheduler Event IDs (bit position is the dispatch priority, highest first)
 		#define LETIMER0_COMP0_EVT		0x00000001 /**< Scheduler Event ID for LETIMER0_COMP0_EVT  **/
 		#define LETIMER0_COMP1_EVT		0x00000002 /**< Scheduler Event ID for LETIMER0_COMP1_EVT  **/
 		#define LETIMER0_UF_EVT			0x00000004 /**< Scheduler Event ID for LETIMER0_UF_EVT     **/
 		#define I2C_SI7021_EVT			0x00000008 /**< Scheduler Event ID for I2C_DONE_EVT        **/
 		#define LEUART_RX_DONE_EVT		0x00000010 /**< Scheduler Event ID for LEUART0_RX_DONE_EVT **/
 		#define LEUART_TX_DONE_EVT		0x00000020 /**< Scheduler Event ID for LEUART0_TX_DONE_EVT **/
+		#define SAMPLE_TIMER_EVT		0x00000040 /**< Scheduler Event ID for SAMPLE_TIMER_EVT    **/
+		#define BLE_AT_TIMEOUT_EVT		0x00000080 /**< Scheduler Event ID for BLE_AT_TIMEOUT_EVT  **/
+		#define BLE_AT_DONE_EVT			0x00000100 /**< Scheduler Event ID for BLE_AT_DONE_EVT     **/
+		#define HM10_STATE_EVT			0x00000200 /**< Scheduler Event ID for HM10_STATE_EVT      **/
+		#define SI7021_READ_EVT			0x00000400 /**< Scheduler Event ID for SI7021_READ_EVT     **/
+		#define HM10_LINK_EVT			0x00000800 /**< Scheduler Event ID for HM10_LINK_EVT       **/
 		#define BOOT_UP_EVT				0x80000000 /**< Scheduler Event ID for BOOT_UP_EVT (MAX)   **/
 
-		#define APP_CMD_TEMPK "<tempK>"		/**< BLE RX CMD for temperature mode Kelvin     **/
-		#define APP_CMD_TEMPF "<tempF>"		/**< BLE RX CMD for temperature mode Fahrenheit **/
-		#define APP_CMD_TEMPC "<tempC>"		/**< BLE RX CMD for temperature mode Celsius    **/
+	// Console Commands, sent as <name> or <name=arg>
+		#define APP_CMD_TEMPK  "tempK"		/**< BLE RX CMD for temperature mode Kelvin     **/
+		#define APP_CMD_TEMPF  "tempF"		/**< BLE RX CMD for temperature mode Fahrenheit **/
+		#define APP_CMD_TEMPC  "tempC"		/**< BLE RX CMD for temperature mode Celsius    **/
+		#define APP_CMD_UNIT   "unit"		/**< BLE RX CMD for the temperature mode, <unit=K>, <unit=F> or <unit=C> **/
+		#define APP_CMD_RATE   "rate"		/**< BLE RX CMD for the sample period in ms, <rate=500> **/
+		#define APP_CMD_THRESH "thresh"		/**< BLE RX CMD for the LED1 threshold in Fahrenheit, <thresh=80.5> **/
+		#define APP_CMD_STATS  "stats"		/**< BLE RX CMD to dump the scheduler statistics **/
+		#define APP_CMD_SLEEP  "sleep"		/**< BLE RX CMD to dump energy mode residency and wake-ups **/
+		#define APP_CMD_LOG    "log"		/**< BLE RX CMD to dump the sample log, oldest first **/
 	/**
 	 * @brief
 	 * TODO: left off here I2C State Machine Enumeration
@@ -72,6 +99,12 @@ void scheduled_letimer0_comp1_evt(void);
 void scheduled_i2c_si7021_evt(void);
 void scheduled_leuart_rx_done_evt(void);
 void scheduled_leuart_tx_done_evt(void);
+void scheduled_sample_timer_evt(void);
+void scheduled_ble_at_timeout_evt(void);
+void scheduled_ble_at_done_evt(void);
+void scheduled_hm10_state_evt(void);
+void scheduled_hm10_link_evt(void);
+void scheduled_si7021_read_evt(void);
 void scheduled_boot_up_evt(void);
 
 #endif /* APP_H */
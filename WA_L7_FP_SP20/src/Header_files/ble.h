@@ -4,18 +4,50 @@
 
 #ifndef BLE_H
 #define BLE_H
-//#define BLE_TEST_ENABLED
+#define BLE_AT_CONFIG_ENABLED	/**< configure the HM-10 (name, power, advertising, baud, STATE pin) with AT commands at boot, comment out to send regardless of the connection **/
 
 #include <stdbool.h>
 #include <stdint.h>
 
 #include "leuart.h"
+#include "ring.h"
 #include "em_leuart.h"
 
 #define CIRC_TEST true			/**< boolean value indicating if the call to pop is for TDD or not **/
 #define CIRC_TEST_SIZE 3		/**< number of test strings, used for the CIRC_TEST_STRUCT **/
-#define CSIZE 128				/**< number of characters in the circular buffer (usable is 1 less) **/
-#define BLE_STR_SIZE 32			/**< size of the ble tx string for LEUART (LEUART receives a pointer of this) **/
+#define CSIZE 128				/**< number of characters in the circular buffer, MUST BE POWER OF 2 (all usable) **/
+#define BLE_STR_SIZE 32			/**< size of a formatted ble line, and twice the size of the ble rx string **/
+#define BLE_PACKETS 16			/**< number of packets the circular buffer can hold, MUST BE POWER OF 2 **/
+#define BLE_TX_FRAME_BUDGET 20	/**< queued packets are sent together in one LEUART transfer, up to this many bytes (one BLE notification) **/
+#define BLE_LEN_MASK 0x7FFF		/**< length entry bits holding the packet length **/
+#define BLE_LEN_TELEMETRY 0x8000	/**< length entry bit marking a telemetry packet, see ble_write_telemetry() **/
+#define BLE_RX_SIZE 64			/**< size of the ble rx ring, holds received command frames, MUST BE POWER OF 2 **/
+
+/**
+ * @brief
+ * Result of ble_write() / ble_write_telemetry()
+ **/
+typedef enum
+{
+	BLE_WRITE_OK,			/**< queued **/
+	BLE_WRITE_DISPLACED,	/**< queued, after dropping older packets to make room **/
+	BLE_WRITE_DROPPED,		/**< not queued, the buffer is full **/
+	BLE_WRITE_TOO_LONG		/**< not queued, longer than the buffer can ever hold **/
+} ble_write_t;
+
+/**
+ * @brief
+ * What ble_write() does when the circular buffer is full
+ **/
+typedef enum
+{
+	BLE_DROP_NEWEST,			/**< reject the new packet **/
+	BLE_DROP_OLDEST,			/**< drop queued packets, oldest first, until the new one fits **/
+	BLE_OVERWRITE_TELEMETRY		/**< a new telemetry packet replaces the newest queued telemetry packet, anything else is rejected **/
+} ble_policy_t;
+
+#define BLE_OVERFLOW_POLICY	BLE_OVERWRITE_TELEMETRY	/**< overflow policy after ble_open() **/
+#define BLE_CMD_POLICY		"policy"				/**< BLE RX CMD to select the overflow policy, <policy=0> to <policy=2> in ble_policy_t order **/
 
 /**
  * @brief
@@ -23,11 +55,10 @@
  **/
 typedef struct
 {
-	char	cbuf[CSIZE];		/**< char array for the circular buffer **/
-	uint8_t	size_mask;			/**< mask, based on the size (relies on power of 2 math) **/
-	uint32_t size;				/**< size of the circular buffer, MUST BE POWER OF 2 **/
-	uint32_t read_ptr;			/**< read index between 0 and size **/
-	uint32_t write_ptr;			/**< write index between 0 and size **/
+	uint8_t		cbuf[CSIZE];				/**< storage for body, packet bodies back to back **/
+	uint8_t		len_buf[BLE_PACKETS * 2];	/**< storage for lens, one 16 bit length entry per packet **/
+	RING_STRUCT	body;						/**< ring of packet bodies **/
+	RING_STRUCT	lens;						/**< ring of length entries, in the same order as the bodies **/
 } BLE_CIRCULAR_BUF;
 
 /**
@@ -41,7 +72,7 @@ typedef struct
 } CIRC_TEST_STRUCT;
 
 void ble_circ_init(void);
-void ble_circ_push(char *);
+ble_write_t ble_circ_push(char *, bool);
 void circular_buff_test(void);
 bool ble_circ_pop(bool);
 
@@ -57,7 +88,45 @@ bool ble_circ_pop(bool);
 #define HM10_STARTF		'<'		/**< BLE RX CMD STARTF **/
 #define HM10_SIGF		'>'		/**< BLE RX CMD SIGF **/
 
-#define LEUART_TX_DMA		true				/**< TODO: Unused, for future implementation of LDMA **/
+#define LEUART_TX_DMA		true				/**< transmit through LDMA instead of one TXBL interrupt per byte **/
+#define LEUART_RX_DMA		true				/**< receive through LDMA, one SIGF interrupt per frame instead of one RXDATAV interrupt per byte **/
+#ifdef BLE_AT_CONFIG_ENABLED
+	#define BLE_LINK_GATING	true				/**< hold the TX queue while no phone is connected, needs a steady STATE pin (AT+PIO11, sent by ble_configure()) **/
+#else
+	#define BLE_LINK_GATING	false				/**< an unconfigured HM-10 blinks STATE while advertising (and only reports OK+CONN / OK+LOST after AT+NOTI1), so the link is taken as always up **/
+#endif
+
+//HM-10 AT configuration, see ble_configure()
+#define HM10_AT_POWER		"2"					/**< AT+POWE code, 2 = 0 dBm **/
+#define HM10_AT_ADVI		"5"					/**< AT+ADVI code, 5 = 546.25 ms advertising interval **/
+#define HM10_AT_BAUD		"0"					/**< AT+BAUD code for HM10_BAUDRATE, 0 = 9600 **/
+#define HM10_AT_PIO1		"1"					/**< AT+PIO1 code, 1 = STATE pin low while advertising instead of blinking **/
+#define BLE_AT_QUEUE		8					/**< number of AT commands ble_at_push() can queue **/
+#define BLE_AT_LEN			24					/**< longest AT command or response, including the terminator **/
+#define BLE_AT_TIMEOUT_MS	500					/**< time the HM-10 has to answer an AT command **/
+#define BLE_AT_RESET_MS		1500				/**< time the HM-10 has to answer AT+RESET **/
+
+/**
+ * @brief
+ * AT engine state
+ **/
+typedef enum
+{
+	BLE_AT_IDLE,		/**< no exchange, RX receives '<' '>' commands **/
+	BLE_AT_SEND,		/**< waiting for LEUART TX to send the next command **/
+	BLE_AT_WAIT			/**< command sent, waiting for the response or the timeout **/
+} ble_at_state_t;
+
+/**
+ * @brief
+ * One command / expected response pair of the AT engine
+ **/
+typedef struct
+{
+	char		cmd[BLE_AT_LEN];		/**< command sent to the HM-10 **/
+	char		resp[BLE_AT_LEN];		/**< response that completes the command **/
+	uint32_t	timeout_ms;				/**< time the HM-10 has to answer **/
+} BLE_AT_STRUCT;
 
 #define LEUART0_TX_RLOC		LEUART_ROUTELOC0_TXLOC_LOC18	/**< LEUART route location for TX pin to HM-10 **/
 #define LEUART0_RX_RLOC		LEUART_ROUTELOC0_RXLOC_LOC18	/**< LEUART route location for RX pin to HM-10 **/
@@ -65,8 +134,21 @@ bool ble_circ_pop(bool);
 #define LEUART0_RX_RPEN		LEUART_ROUTEPEN_RXPEN			/**< LEUART route pin enabling for RX pin **/
 
 void ble_open(uint32_t tx_event, uint32_t rx_event);
-void ble_write(char *string);
-bool ble_test(char *mod_name);
+ble_write_t ble_write(char *string);
+ble_write_t ble_write_telemetry(char *string);
+void ble_overflow_policy(ble_policy_t policy);
+uint32_t ble_drops(void);
+uint32_t ble_rx_drops(void);
+uint32_t ble_rx_rejects(void);
+bool ble_tx_idle(void);
+void ble_link(bool connected);
+bool ble_connected(void);
+void ble_at_open(uint32_t timer, uint32_t timeout_event, uint32_t done_event);
+bool ble_at_push(const char *cmd, const char *resp, uint32_t timeout_ms);
+bool ble_at_start(void);
+void ble_at_timeout(void);
+bool ble_at_busy(void);
+bool ble_configure(char *mod_name);
 void ble_rx_test();
 char * ble_getCMD();
 
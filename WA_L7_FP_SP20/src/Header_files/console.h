@@ -0,0 +1,84 @@
+/**
+ * @file console.h
+ **/
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdint.h>
+#include <stdbool.h>
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define CONSOLE_COMMANDS	16		/**< size of the command table **/
+#define CONSOLE_STARTF		'<'		/**< first character of a command frame **/
+#define CONSOLE_SIGF		'>'		/**< last character of a command frame **/
+#define CONSOLE_ARGSEP		'='		/**< separates the command name from its argument **/
+#define CONSOLE_CENTI		100		/**< CONSOLE_ARG_CENTI arguments are in 1 / CONSOLE_CENTI units **/
+
+/**
+ * @brief
+ * Argument schema of a console command
+ **/
+typedef enum
+{
+	CONSOLE_ARG_NONE,		/**< <name>, no argument **/
+	CONSOLE_ARG_UINT,		/**< <name=500>, unsigned decimal **/
+	CONSOLE_ARG_CENTI,		/**< <name=-80.5>, signed decimal with up to two decimal places, in hundredths **/
+	CONSOLE_ARG_CHAR		/**< <name=K>, a single character **/
+} console_arg_t;
+
+/**
+ * @brief
+ * Parsed argument, the member used is given by the command's console_arg_t
+ **/
+typedef union
+{
+	uint32_t	uint;		/**< CONSOLE_ARG_UINT **/
+	int32_t		centi;		/**< CONSOLE_ARG_CENTI, value * CONSOLE_CENTI **/
+	char		chr;		/**< CONSOLE_ARG_CHAR **/
+} console_value_t;
+
+/**
+ * @brief
+ * Console command handler
+ * @returns
+ * false if the argument is out of range, nothing is changed
+ **/
+typedef bool (*console_handler_t)(console_value_t arg);
+
+/**
+ * @brief
+ * Result of console_dispatch()
+ **/
+typedef enum
+{
+	CONSOLE_OK,				/**< the handler ran **/
+	CONSOLE_BAD_FRAME,		/**< not a <name> or <name=arg> frame **/
+	CONSOLE_UNKNOWN,		/**< no command of that name **/
+	CONSOLE_BAD_ARG			/**< the argument does not fit the schema, or the handler rejected it **/
+} console_result_t;
+
+/**
+ * @brief
+ * Entry of the command table
+ **/
+typedef struct
+{
+	const char *		name;		/**< command name, without the frame characters **/
+	console_arg_t		arg;		/**< argument schema **/
+	console_handler_t	handler;	/**< called with the parsed argument **/
+} CONSOLE_COMMAND_STRUCT;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void console_open(void);
+void console_register(const char * name, console_arg_t arg, console_handler_t handler);
+console_result_t console_dispatch(char * frame);
+void console_test(void);
+
+#endif /* CONSOLE_H */
@@ -0,0 +1,47 @@
+/**
+ * @file fmt.h
+ **/
+#ifndef FMT_H
+#define FMT_H
+//#define FMT_BENCH_SNPRINTF	/**< build fmt_bench_snprintf(), links newlib's formatted output in for the comparison (always on in the host build, see test/) **/
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdint.h>
+#include <stddef.h>
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define FMT_BENCH_LINES		64		/**< telemetry lines formatted by the fmt_test() benchmark **/
+
+/**
+ * @brief
+ * Line being formatted
+ * @details
+ * Each fmt_ call appends to buf, anything past size - 1 characters is cut off and buf
+ * always stays terminated, so a line can be built without checking every step
+ **/
+typedef struct
+{
+	char *		buf;		/**< output, size bytes **/
+	uint32_t	size;		/**< size of buf **/
+	uint32_t	len;		/**< characters in buf, not counting the terminator **/
+} FMT_STRUCT;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void fmt_init(FMT_STRUCT * fmt, char * buf, size_t size);
+void fmt_char(FMT_STRUCT * fmt, char c);
+void fmt_str(FMT_STRUCT * fmt, const char * s);
+void fmt_uint(FMT_STRUCT * fmt, uint32_t value);
+void fmt_int(FMT_STRUCT * fmt, int32_t value);
+void fmt_fixed(FMT_STRUCT * fmt, int32_t value, uint32_t frac_digits);
+uint32_t fmt_test(void);
+#ifdef FMT_BENCH_SNPRINTF
+uint32_t fmt_bench_snprintf(void);
+#endif
+
+#endif /* FMT_H */
@@ -33,7 +33,14 @@
 	#define LEUART_RX_PIN		11				/**< HM-10 (BLE) LEUART RX GPIO Pin **/
 	#define LEUART_TX_PORT		gpioPortD		/**< HM-10 (BLE) LEUART TX GPIO Port **/
 	#define LEUART_TX_PIN		10				/**< HM-10 (BLE) LEUART TX GPIO Pin **/
+	#define HM10_STATE_PORT		gpioPortD		/**< HM-10 (BLE) STATE GPIO Port, high while a phone is connected **/
+	#define HM10_STATE_PIN		12				/**< HM-10 (BLE) STATE GPIO Pin, also its external interrupt number **/
+	// External Interrupts
+	#define GPIO_EXT_INTS		16				/**< number of GPIO external interrupts, interrupt n serves pin n **/
 
 void gpio_open(void);
+void gpio_int_open(GPIO_Port_TypeDef port, uint32_t pin, uint32_t event);
+void GPIO_EVEN_IRQHandler(void);
+void GPIO_ODD_IRQHandler(void);
 
 #endif /* GPIO_H */
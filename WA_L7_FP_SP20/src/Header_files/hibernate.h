@@ -0,0 +1,29 @@
+/**
+ * @file hibernate.h
+ **/
+#ifndef HIBERNATE_H
+#define HIBERNATE_H
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdint.h>
+#include <stdbool.h>
+#include "em_rtcc.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define HIBERNATE_RET_WORDS		32				/**< RTCC retention registers, kept through EM4H **/
+#define HIBERNATE_STATE_WORDS	(HIBERNATE_RET_WORDS - 2)	/**< words left for state, after the magic and checksum **/
+#define HIBERNATE_MAGIC			0x48424E00u		/**< marks valid retained state, low byte holds the state size in words **/
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void hibernate_open(void);
+bool hibernate_resumed(void);
+bool hibernate_restore(void * state, uint32_t size);
+void hibernate_enter(const void * state, uint32_t size);
+
+#endif /* HIBERNATE_H */
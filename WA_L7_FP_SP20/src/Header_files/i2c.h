@@ -16,6 +16,10 @@
 	#define I2C_DIR_WRITE	0		/**< I2C direction write bit, to be transmitted in start byte as LSB (with device address) **/
 	#define I2C_DIR_READ	1		/**< I2C direction read bit, to be transmitted in start byte as LSB (with device address) **/
 	#define GENERAL_BYTE_SHIFT 8	/**< Generic definition of bits in a byte, used for shifting buffers with RXDATA **/
+	#define I2C_PAYLOAD_BYTES	3	/**< received bytes packed into the low bits of the completion event's payload **/
+	#define I2C_PAYLOAD_STATUS_SHIFT	24	/**< the transaction's i2c_status_t sits above the received bytes in the payload **/
+	#define I2C_QUEUE			4	/**< transactions each bus queues behind the one in progress, MUST BE POWER OF 2 **/
+	#define I2C_BUSES			2	/**< I2C0 and I2C1 **/
 //enums
 	/**
 	 * @brief
@@ -23,14 +27,24 @@
 	 **/
 	typedef enum
 	{
-		I2C_STATE_IDLE,		/**< Idle state **/
-		I2C_STATE_START,	/**< Send the start command **/
-		I2C_STATE_CMDW,		/**< Send the write command **/
-		I2C_STATE_CMDR,		/**< Send the read command **/
-		I2C_STATE_RX_MSB,	/**< Receive the most significant byte from the device **/
-		I2C_STATE_RX_LSB,	/**< Receive the least significant byte from the device **/
-		I2C_STATE_DONE		/**< Done reading from the device **/
+		I2C_STATE_IDLE,		/**< Idle state, the descriptor may be (re)started **/
+		I2C_STATE_QUEUED,	/**< Waiting for the bus **/
+		I2C_STATE_ADDRW,	/**< Start and device address sent, for a write **/
+		I2C_STATE_TX,		/**< Writing tx_buf to the device **/
+		I2C_STATE_RESTART,	/**< Stopped after the write, start the read from MSTOP **/
+		I2C_STATE_ADDRR,	/**< Start and device address sent, for a read **/
+		I2C_STATE_RX,		/**< Reading rx_buf from the device **/
+		I2C_STATE_DONE		/**< Stop sent, the transaction completes at MSTOP **/
 	} i2c_read_state_t;
+	/**
+	 * @brief
+	 * I2C transaction completion status
+	 **/
+	typedef enum
+	{
+		I2C_STATUS_OK,		/**< every byte was acknowledged **/
+		I2C_STATUS_NACK		/**< the device NACKed its address or a written byte, the transaction was stopped there **/
+	} i2c_status_t;
 //structs
 	/**
 	 * @brief
@@ -63,26 +77,49 @@
 	} I2C_IO_STRUCT;
 	/**
 	 * @brief
-	 * Structure used to retain information used for I2C
+	 * I2C transaction descriptor, passed to i2c_start()
+	 * @details
+	 * tx_len bytes are written, then rx_len bytes are read: write-only (rx_len 0), read-only
+	 * (tx_len 0) or write-then-read, so a register address followed by a burst read of
+	 * consecutive registers is one transaction. The descriptor must stay valid until the
+	 * completion event.
 	 **/
 	typedef struct
 	{
+		uint32_t dev_addr;					/**< Device address value, 7 bit **/
+		const uint8_t * tx_buf;				/**< bytes to write, usually a register address or command first **/
+		uint32_t tx_len;					/**< bytes to write **/
+		uint8_t * rx_buf;					/**< received bytes, in bus order **/
+		uint32_t rx_len;					/**< bytes to read **/
+		bool restart;						/**< write-then-read: repeated start (true), or stop then start (false) **/
+		bool nack_retry;					/**< address the read again while the device NACKs it (Si7021 no hold master mode) **/
+		uint32_t dev_evt;					/**< Device scheduler event, posted with the status and the first I2C_PAYLOAD_BYTES received bytes, MSB first, 0 for none **/
+		// driver state
 		i2c_read_state_t i2c_state;			/**< I2C's state machine **/
-		I2C_TypeDef * i2c;					/**< I2C's i2c pointer, unused **/
-		uint32_t dev_addr;					/**< Device address value **/
-		uint32_t dev_cmd;					/**< Device register / command **/
-		uint32_t dev_evt;					/**< Device scheduler event **/
-		uint16_t * dev_buffer;				/**< Device buffer pointer **/
-		bool read;							/**< I2C read or write operation **/
-// 	ECEN 4593 IMPLEMENTATION
-//		int_fast8_t rx_bytes;				< I2C's bytes received tracker (helps with state machine)
-//		int_fast8_t rx_max;					< I2C's max bytes to receive
+		i2c_status_t status;				/**< how the last transaction ended, valid once i2c_state is back to I2C_STATE_IDLE **/
+		uint32_t tx_count;					/**< bytes written so far **/
+		uint32_t rx_count;					/**< bytes read so far **/
 	} I2C_PAYLOAD_STRUCT;
+	/**
+	 * @brief
+	 * Per bus context: the transaction in progress and the ones waiting for the bus
+	 * @details
+	 * head and tail run freely and are only masked on access. i2c_start() is the only
+	 * producer, the bus's IRQ handler the only consumer.
+	 **/
+	typedef struct
+	{
+		I2C_PAYLOAD_STRUCT * active;				/**< transaction on the bus, NULL if idle **/
+		I2C_PAYLOAD_STRUCT * queue[I2C_QUEUE];		/**< transactions waiting for the bus, oldest at tail **/
+		volatile uint32_t head;						/**< free running write index of queue **/
+		volatile uint32_t tail;						/**< free running read index of queue **/
+	} I2C_BUS_STRUCT;
 
 // functions
 	void i2c_open(I2C_TypeDef *, I2C_OPEN_STRUCT *, I2C_IO_STRUCT *);
 	void i2c_bus_reset(I2C_TypeDef *, I2C_IO_STRUCT *);
-	void i2c_start(I2C_TypeDef *, I2C_PAYLOAD_STRUCT *);
+	bool i2c_start(I2C_TypeDef *, I2C_PAYLOAD_STRUCT *);
+	bool i2c_busy(I2C_TypeDef *);
 	// LPM
 	void i2c_enable_interrupts(I2C_TypeDef *, I2C_IO_STRUCT *);
 	void i2c_disable_interrupts(I2C_TypeDef *);
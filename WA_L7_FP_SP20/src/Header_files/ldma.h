@@ -1,9 +1,20 @@
+/**
+ * @file ldma.h
+ **/
 #ifndef LDMA_H
 #define LDMA_H
 
-#define LDMA_CHANNEL_LEUART_RX	0
-#define LDMA_CHANNEL_LEUART_TX	1
+#include <stdint.h>
+#include <stdbool.h>
+#include "em_ldma.h"
 
+#define LDMA_CHANNEL_LEUART_RX	0		/**< LDMA channel for LEUART0 RX **/
+#define LDMA_CHANNEL_LEUART_TX	1		/**< LDMA channel for LEUART0 TX **/
+
+/**
+ * @brief
+ * LDMA channels in use
+ **/
 typedef enum
 {
 	LDMA_CHANNEL0,
@@ -17,7 +28,11 @@ typedef enum
 	LDMA_CHANNELS
 } ldma_channel_t;
 
-void ldma_open(ldma_channel_t);
+void ldma_open(void);
+void ldma_start(ldma_channel_t channel, const LDMA_TransferCfg_t * ldma_transfercfg, const LDMA_Descriptor_t * ldma_descriptor);
+void ldma_stop(ldma_channel_t channel);
+bool ldma_busy(ldma_channel_t channel);
+uint32_t ldma_dst(ldma_channel_t channel);
 void LDMA_IRQHandler(void);
 
 #endif /* LDMA_H */
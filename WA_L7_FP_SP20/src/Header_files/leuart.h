@@ -7,6 +7,7 @@
 
 #include "em_leuart.h"
 #include "sleep_routines.h"
+#include "ring.h"
 
 #define LEUART_TX_EM_BLOCK EM3 	/**< lowest energy mode LEUART can TX in **/
 #define LEUART_RX_EM_BLOCK EM3	/**< lowest energy mode LEUART can RX in **/
@@ -60,11 +61,10 @@ typedef struct
 	bool						rxdatav_en;		/**< LEUART RXDATAV interrupt enable **/
 	char						sigframe;		/**< LEUART SIGF character (8 bit only) **/
 	// RX
-	int							rxlen;			/**< LEUART RXSTRING length **/
-	char *						rxstring;		/**< LEUART RXSTRING pointer **/
+	RING_STRUCT *				rx_ring;		/**< LEUART RX ring, each frame is committed to it on SIGF **/
 	// DMA
-	bool 						rx_dma;			/**< TODO: Unused. Enables RX DMA in EM2 **/
-	bool 						tx_dma;			/**< TODO: Unused. Enables TX DMA in EM2 **/
+	bool 						rx_dma;			/**< Receive through LDMA (also in EM2) into rx_ring, waking only on SIGF **/
+	bool 						tx_dma;			/**< Transmit through LDMA (also in EM2), waking only on TXC **/
 	// Scheduler Event IDs
 	uint32_t *					rx_done_evt;	/**< Scheduler ID for RX Done event **/
 	uint32_t *					tx_done_evt;	/**< Scheduler ID for TX Done event **/
@@ -72,9 +72,13 @@ typedef struct
 
 void leuart_open(LEUART_TypeDef *leuart, LEUART_OPEN_STRUCT * leuart_settings);
 void LEUART0_IRQHandler(void);
-void leuart_start(LEUART_TypeDef *leuart, char *string, uint32_t string_len);
+bool leuart_start(LEUART_TypeDef *leuart, char *string, uint32_t string_len);
+bool leuart_start_segments(LEUART_TypeDef *leuart, char *string0, uint32_t len0, char *string1, uint32_t len1);
 bool leuart_tx_busy(LEUART_TypeDef *leuart);
 bool leuart_rx_busy();
+void leuart_rx_frame(LEUART_TypeDef *leuart, char startframe, char sigframe, bool block);
+uint32_t leuart_rx_drops(void);
+void leuart_rx_resume(void);
 
 uint32_t leuart_status(LEUART_TypeDef *leuart);
 void leuart_cmd_write(LEUART_TypeDef *leuart, uint32_t cmd_update);
@@ -0,0 +1,53 @@
+/**
+ * @file ring.h
+ **/
+#ifndef RING_H
+#define RING_H
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdint.h>
+#include <stdbool.h>
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define RING_TEST_SIZE		64		/**< size of the ring used by ring_test() **/
+#define RING_BENCH_BYTES	1024	/**< bytes moved through the ring by the ring_test() benchmark **/
+
+/**
+ * @brief
+ * Single producer / single consumer ring buffer of bytes
+ * @details
+ * head and tail run freely and are only masked on access, so all size bytes are usable
+ * (head - tail is the fill level). Only the producer writes head, only the consumer
+ * writes tail, so one side may be an IRQ handler without masking interrupts.
+ **/
+typedef struct
+{
+	uint8_t *			buf;		/**< storage, size bytes **/
+	uint32_t			size;		/**< size of buf, MUST BE POWER OF 2 **/
+	uint32_t			mask;		/**< size - 1 **/
+	volatile uint32_t	head;		/**< free running write index, owned by the producer **/
+	volatile uint32_t	tail;		/**< free running read index, owned by the consumer **/
+} RING_STRUCT;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void ring_init(RING_STRUCT * ring, uint8_t * buf, uint32_t size);
+uint32_t ring_count(const RING_STRUCT * ring);
+uint32_t ring_space(const RING_STRUCT * ring);
+uint32_t ring_write(RING_STRUCT * ring, const void * data, uint32_t len);
+uint32_t ring_read(RING_STRUCT * ring, void * data, uint32_t len);
+uint8_t * ring_read_at(const RING_STRUCT * ring, uint32_t offset);
+uint8_t * ring_write_at(const RING_STRUCT * ring, uint32_t offset);
+uint32_t ring_read_span(const RING_STRUCT * ring, uint32_t offset, uint8_t ** span);
+uint32_t ring_write_span(const RING_STRUCT * ring, uint8_t ** span);
+void ring_read_commit(RING_STRUCT * ring, uint32_t len);
+void ring_write_commit(RING_STRUCT * ring, uint32_t len);
+void ring_unwrite(RING_STRUCT * ring, uint32_t len);
+uint32_t ring_test(void);
+
+#endif /* RING_H */
@@ -8,13 +8,61 @@
 #define	SCHEDULER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "em_assert.h"
 
 
 //***********************************************************************************
 // defined files
 //***********************************************************************************
+#define SCHEDULER_EVENTS	32		/**< number of event bits in the scheduler, one handler slot per bit **/
 
+/**
+ * @brief
+ * Scheduled event handler, called from the main loop by scheduler_dispatch()
+ **/
+typedef void (*scheduler_callback_t)(void);
+
+#define SCHEDULER_QUEUE_SIZE	16		/**< number of records in the event queue, MUST BE POWER OF 2 **/
+
+/**
+ * @brief
+ * Record held in the scheduler's event queue, for events that carry data
+ **/
+typedef struct
+{
+	uint32_t event;			/**< event (single bit) this record belongs to **/
+	uint32_t timestamp;		/**< DWT cycle count when the record was posted **/
+	uint32_t payload;		/**< small payload, or a pointer to data that outlives the record **/
+} SCHEDULER_RECORD_STRUCT;
+
+//#define SCHEDULER_STATS_ENABLED		/**< build the dispatch instrumentation, costs a DWT read on every add_scheduled_event() **/
+#define SCHEDULER_STATS_BUCKETS	24		/**< log2 histogram buckets, bucket n counts [2^n, 2^(n+1)) cycles, the last is open ended **/
+
+#ifdef SCHEDULER_STATS_ENABLED
+/**
+ * @brief
+ * Cycle count statistics for one measurement (queueing delay or handler runtime)
+ **/
+typedef struct
+{
+	uint32_t count;		/**< number of samples **/
+	uint32_t min;		/**< smallest sample, in DWT cycles **/
+	uint32_t max;		/**< largest sample, in DWT cycles **/
+	uint64_t sum;		/**< sum of all samples, mean = sum / count **/
+	uint16_t hist[SCHEDULER_STATS_BUCKETS];	/**< log2 histogram, saturates at 0xFFFF **/
+} SCHEDULER_TIMING_STRUCT;
+
+/**
+ * @brief
+ * Dispatch statistics kept per event
+ **/
+typedef struct
+{
+	SCHEDULER_TIMING_STRUCT delay;		/**< cycles from the event's bit being set to its handler being called **/
+	SCHEDULER_TIMING_STRUCT runtime;	/**< cycles spent in the handler **/
+} SCHEDULER_STATS_STRUCT;
+#endif
 
 //***********************************************************************************
 // global variables
@@ -28,5 +76,16 @@ void scheduler_open(void);
 void add_scheduled_event(uint32_t event);
 void remove_scheduled_event(uint32_t event);
 uint32_t get_scheduled_events(void);
+uint32_t fetch_scheduled_event(void);
+bool post_scheduled_event(uint32_t event, uint32_t payload);
+bool pop_scheduled_event(uint32_t event, SCHEDULER_RECORD_STRUCT * record);
+uint32_t get_scheduled_count(uint32_t event);
+uint32_t get_scheduler_queue_drops(void);
+void scheduler_register_event(uint32_t event, scheduler_callback_t callback);
+bool scheduler_dispatch(void);
+#ifdef SCHEDULER_STATS_ENABLED
+const SCHEDULER_STATS_STRUCT * get_scheduler_stats(uint32_t event);
+void scheduler_stats_reset(void);
+#endif
 
 #endif /* SCHEDULER_H */
@@ -5,6 +5,17 @@
 
 #define SI7021_DEV_ADDR				0x40						/**< Si7021 Device Address **/
 #define SI7021_TEMP_NO_HOLD			0xF3						/**< Register Address for measure temp, no hold **/
+#define SI7021_TEMP_BITS			14							/**< temperature resolution, the power-on default, other values need user register 1 written first **/
+#if SI7021_TEMP_BITS == 14
+	#define SI7021_CONV_MS			11							/**< 14 bit temperature conversion time, 10.8 ms max (datasheet) **/
+#elif SI7021_TEMP_BITS == 13
+	#define SI7021_CONV_MS			7							/**< 13 bit temperature conversion time, 6.2 ms max (datasheet) **/
+#elif SI7021_TEMP_BITS == 12
+	#define SI7021_CONV_MS			4							/**< 12 bit temperature conversion time, 3.8 ms max (datasheet) **/
+#elif SI7021_TEMP_BITS == 11
+	#define SI7021_CONV_MS			3							/**< 11 bit temperature conversion time, 2.4 ms max (datasheet) **/
+#endif
+#define SI7021_RETRY_MS				2							/**< wait before retrying a read that found the I2C queue full **/
 #define SI7021_I2C_FREQ				I2C_FREQ_FAST_MAX			/**< Si7021 I2C frequency **/
 #define SI7021_I2C_CLK_RATIO		I2C_CTRL_CLHR_STANDARD		/** Clock Ratio, same as i2cClockHLRStandard **/
 #define SI7021_SCL_EN				I2C_ROUTEPEN_SCLPEN			/**< I2C SCL enable **/
@@ -19,14 +30,31 @@
 	#define SI7021_SCL_LOC			I2C_ROUTELOC0_SCLLOC_LOC19	/**< I2C1 SCL route location info **/
 	#define SI7021_SDA_LOC			I2C_ROUTELOC0_SDALOC_LOC19	/**< I2C1 SDA route location info **/
 #endif
+#define SI7021_NEVER				0x10000						/**< si7021_raw_threshold() result when no reading reaches the threshold **/
+
+/**
+ * @brief
+ * A Si7021 temperature reading, converted once when it completes
+ **/
+typedef struct
+{
+	uint16_t	raw;		/**< raw reading, as posted with I2C_SI7021_EVT **/
+	int32_t		centi_c;	/**< temperature in hundredths of a degree Celsius **/
+} SI7021_SAMPLE_STRUCT;
+
+typedef int32_t (*si7021_unit_t)(const SI7021_SAMPLE_STRUCT * sample);	/**< converts a sample to hundredths of a degree in some unit **/
 
 //function prototypes
-void si7021_i2c_open();
-void si7021_i2c_start();
+void si7021_i2c_open(uint32_t timer, uint32_t read_event);
+bool si7021_i2c_start();
+void si7021_read(void);
+bool si7021_busy(void);
 void si7021_lpm_enable(void);
 void si7021_lpm_disable(void);
-float si7021_temp_K();
-float si7021_temp_F();
-float si7021_temp_C();
+void si7021_sample(uint16_t raw, SI7021_SAMPLE_STRUCT * sample);
+int32_t si7021_centi_K(const SI7021_SAMPLE_STRUCT * sample);
+int32_t si7021_centi_F(const SI7021_SAMPLE_STRUCT * sample);
+int32_t si7021_centi_C(const SI7021_SAMPLE_STRUCT * sample);
+uint32_t si7021_raw_threshold(int32_t centi, si7021_unit_t unit);
 
 #endif /* SI7021_H */
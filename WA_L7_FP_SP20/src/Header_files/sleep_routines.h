@@ -52,10 +52,34 @@
 //	em_count
 //};
 
+/**
+ * @brief
+ * Sleep block owners, each owner holds at most one block per energy mode
+ **/
+typedef enum
+{
+	SLEEP_OWNER_LETIMER0,		/**< LETIMER0 while running **/
+	SLEEP_OWNER_I2C0,			/**< I2C0 during a transfer **/
+	SLEEP_OWNER_I2C1,			/**< I2C1 during a transfer **/
+	SLEEP_OWNER_LEUART0_TX,		/**< LEUART0 during a transmission **/
+	SLEEP_OWNER_LEUART0_RX,		/**< LEUART0 while receiving **/
+	SLEEP_OWNER_SOFT_TIMER,		/**< RTCC while a soft timer is running **/
+	SLEEP_OWNER_COUNT			/**< number of owners, at most 32 **/
+} sleep_owner_t;
+
+#define SLEEP_IRQ_COUNT EXT_IRQ_COUNT	/**< wake-up counters, one per peripheral IRQ (IRQn 0 and up) **/
+
 void sleep_open(void);
-void sleep_block_mode(uint32_t);
-void sleep_unblock_mode(uint32_t);
+void sleep_block_mode(sleep_owner_t owner, uint32_t em);
+void sleep_unblock_mode(sleep_owner_t owner, uint32_t em);
 void enter_sleep(void);
+void sleep_idle(void);
 uint32_t current_block_energy_mode(void);
+uint32_t sleep_block_owners(uint32_t em);
+const char * sleep_owner_name(sleep_owner_t owner);
+uint32_t sleep_residency_ticks(uint32_t em);
+void sleep_residency_restore(const uint32_t * ticks, uint32_t hibernated);
+uint32_t sleep_wakeup_count(uint32_t irq);
+void sleep_stats_reset(void);
 
 #endif /* SLEEP_ROUTINES_H_ */
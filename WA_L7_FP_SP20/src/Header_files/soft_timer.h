@@ -0,0 +1,38 @@
+/**
+ * @file soft_timer.h
+ **/
+#ifndef SOFT_TIMER_H
+#define SOFT_TIMER_H
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdint.h>
+#include <stdbool.h>
+#include "em_rtcc.h"
+#include "sleep_routines.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SOFT_TIMER_HZ		1000		/**< RTCC tick rate in Hz, ULFRCO with no prescaler **/
+#define SOFT_TIMER_COUNT	8			/**< number of soft timers multiplexed onto the RTCC **/
+#define SOFT_TIMER_CC		1			/**< RTCC compare channel, always programmed to the nearest deadline **/
+#define SOFT_TIMER_IF		(RTCC_IF_CC0 << SOFT_TIMER_CC)	/**< RTCC IF / IEN bit of SOFT_TIMER_CC **/
+#define SOFT_TIMER_EM		EM4			/**< energy block while a soft timer runs, keeps PG12 out of EM4 **/
+
+#define SOFT_TIMER_MS(ms)	((uint32_t)(((uint64_t)(ms) * SOFT_TIMER_HZ) / 1000))	/**< converts milliseconds to RTCC ticks **/
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void soft_timer_open(void);
+void soft_timer_start(uint32_t timer, uint32_t delay, uint32_t period, uint32_t event);
+void soft_timer_stop(uint32_t timer);
+bool soft_timer_active(uint32_t timer);
+void soft_timer_arm(void);
+bool soft_timer_next_deadline(uint32_t * ticks);
+uint32_t soft_timer_now(void);
+void RTCC_IRQHandler(void);
+
+#endif /* SOFT_TIMER_H */
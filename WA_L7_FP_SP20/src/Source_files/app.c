@@ -10,21 +10,495 @@
 //***********************************************************************************
 #include "app.h"
 #include "letimer.h"
+#include "soft_timer.h"
 #include "scheduler.h"
 #include "sleep_routines.h"
 #include "si7021.h"
+#include "i2c.h"
 #include "ble.h"
+#include "hibernate.h"
+#include "ring.h"
+#include "console.h"
+#include "fmt.h"
 #include <string.h>
-#include <stdio.h>
 
 temp_mode_t temperatureMode = degreesC;	/**< temperature mode select **/
+static uint32_t sample_count;			/**< Si7021 samples taken since the last cold boot **/
+static uint8_t sample_log_buf[APP_LOG_SIZE];	/**< storage for sample_log **/
+static RING_STRUCT sample_log;			/**< latest raw Si7021 readings, oldest dropped when full **/
+static uint32_t sample_unsent;			/**< newest readings in sample_log not reported yet, taken while no phone was connected **/
+static uint32_t sample_period_ms = SAMPLE_PER_MS;	/**< Si7021 sample period, see APP_CMD_RATE **/
+static int32_t temp_threshold = TEMP_THRESHOLD;	/**< LED1 threshold in hundredths of a degree Fahrenheit, see APP_CMD_THRESH **/
+static uint32_t temp_threshold_raw;		/**< temp_threshold as a raw Si7021 reading, see app_threshold() **/
+
+/**
+ * @brief
+ *	Application state kept through EM4H hibernation
+ **/
+typedef struct
+{
+	uint32_t temp_mode;			/**< temperatureMode **/
+	uint32_t sample_count;		/**< sample_count **/
+	uint32_t sample_period_ms;	/**< sample_period_ms **/
+	int32_t temp_threshold;		/**< temp_threshold **/
+	uint32_t residency[MAX_ENERGY_MODES];	/**< sleep_residency_ticks() of each energy mode **/
+	uint32_t hibernate_tick;	/**< RTCC tick hibernation started at, the RTCC keeps counting through EM4H **/
+} APP_RETAINED_STRUCT;
+
+/**
+ * @brief
+ *	Result of formatting one row of a BLE dump
+ **/
+typedef enum
+{
+	APP_DUMP_LINE,		/**< line holds a row to send **/
+	APP_DUMP_SKIP,		/**< row is empty, go on to the next one **/
+	APP_DUMP_DONE		/**< no rows left **/
+} app_dump_t;
+
+typedef app_dump_t (*app_dump_row_t)(uint32_t row, char * line, size_t size);	/**< formats row of a dump into line **/
+
+static app_dump_row_t dump_row;		/**< row formatter of the dump in progress, 0 when idle **/
+static uint32_t dump_next;			/**< next row of the dump in progress **/
+
+/**
+ * @brief
+ *	Writes the next line of the dump in progress, if any
+ * @note
+ *	Only one line is written at a time, the next one goes out from the TX done event,
+ *	so a long dump never overflows the BLE circular buffer
+ **/
+static void app_dump_continue(void)
+{
+	char line[BLE_STR_SIZE];
+
+	while (dump_row)
+	{
+		switch (dump_row(dump_next++, line, sizeof(line)))
+		{
+			case APP_DUMP_LINE:
+				ble_write(line);
+				return;
+			case APP_DUMP_SKIP:
+				break;
+			default:
+				dump_row = 0;
+				break;
+		}
+	}
+}
+
+/**
+ * @brief
+ *	Starts a BLE dump, replacing any dump in progress
+ * @param[in] row
+ *	row formatter of the dump
+ **/
+static void app_dump_start(app_dump_row_t row)
+{
+	dump_row = row;
+	dump_next = 0;
+	app_dump_continue();
+}
+
+/**
+ * @brief
+ *	Formats a Si7021 reading in the current temperature mode
+ * @param[in] sample
+ *	converted Si7021 reading
+ * @param[out] line
+ *	formatted reading, with its unit and a newline
+ * @param[in] size
+ *	size of line
+ **/
+static void app_format_temp(const SI7021_SAMPLE_STRUCT * sample, char * line, size_t size)
+{
+	FMT_STRUCT fmt;
+	int32_t centi;
+
+	switch (temperatureMode)
+	{
+		case degreesK:
+			centi = si7021_centi_K(sample);
+			break;
+		case degreesF:
+			centi = si7021_centi_F(sample);
+			break;
+		case degreesC:
+			centi = si7021_centi_C(sample);
+			break;
+		default:
+			EFM_ASSERT(false);
+			centi = 0;
+			break;
+	}
+
+	fmt_init(&fmt, line, size);
+	fmt_fixed(&fmt, centi, 2);
+	fmt_char(&fmt, ' ');
+	fmt_char(&fmt, (temperatureMode == degreesC)?'C':(temperatureMode == degreesF)?'F':(temperatureMode == degreesK)?'K':'?');
+	fmt_char(&fmt, '\n');
+}
+
+/**
+ * @brief
+ *	Sets the LED1 threshold
+ * @details
+ *	Converts it to a raw Si7021 reading here, so each sample is compared without
+ *	converting it to Fahrenheit
+ * @param[in] centi_f
+ *	threshold in hundredths of a degree Fahrenheit
+ **/
+static void app_threshold(int32_t centi_f)
+{
+	temp_threshold = centi_f;
+	temp_threshold_raw = si7021_raw_threshold(centi_f, si7021_centi_F);
+}
+
+/**
+ * @brief
+ *	Formats one row of the APP_CMD_LOG dump
+ * @details
+ *	One row per reading in sample_log, oldest first, in the current temperature mode
+ **/
+static app_dump_t app_log_row(uint32_t row, char * line, size_t size)
+{
+	uint8_t * lo = ring_read_at(&sample_log, 2 * row);
+	uint8_t * hi = ring_read_at(&sample_log, 2 * row + 1);
+	SI7021_SAMPLE_STRUCT sample;
+
+	if (!lo || !hi)
+		return APP_DUMP_DONE;
+	si7021_sample(*lo | (*hi << 8), &sample);
+	app_format_temp(&sample, line, size);
+	return APP_DUMP_LINE;
+}
+
+/**
+ * @brief
+ *	Formats one row of the backlog dump, sent when a phone connects
+ * @details
+ *	One row per reading taken while no phone was connected, oldest first. Each row
+ *	counts as reported once formatted, so a dump cut short by a lost connection goes on
+ *	from the same reading at the next connection.
+ **/
+static app_dump_t app_backlog_row(uint32_t row, char * line, size_t size)
+{
+	(void)row;
+	if (!sample_unsent || !ble_connected())
+		return APP_DUMP_DONE;
+	app_log_row(ring_count(&sample_log) / 2 - sample_unsent, line, size);
+	sample_unsent--;
+	return APP_DUMP_LINE;
+}
+
+#ifdef SCHEDULER_STATS_ENABLED
+/**
+ * @brief
+ *	Formats one row of the APP_CMD_STATS dump
+ * @details
+ *	Starts with the records dropped by the scheduler queue and the packets dropped by
+ *	BLE, then the BLE commands dropped (RX ring full) and rejected (too long). Then each dispatched event dumps a queueing delay row and a handler runtime
+ *	row, as count min/mean/max in microseconds, then one row per non-empty log2 bucket
+ *	(bucket n counts [2^n, 2^(n+1)) cycles) as delay and runtime sample counts
+ **/
+static app_dump_t app_stats_row(uint32_t row, char * line, size_t size)
+{
+	FMT_STRUCT fmt;
+
+	fmt_init(&fmt, line, size);
+	if (!row--)
+	{
+		fmt_str(&fmt, "drops ");
+		fmt_uint(&fmt, get_scheduler_queue_drops());
+		fmt_char(&fmt, ' ');
+		fmt_uint(&fmt, ble_drops());
+		fmt_char(&fmt, '\n');
+		return APP_DUMP_LINE;
+	}
+	if (!row--)
+	{
+		fmt_str(&fmt, "rx drops ");
+		fmt_uint(&fmt, ble_rx_drops());
+		fmt_str(&fmt, " long ");
+		fmt_uint(&fmt, ble_rx_rejects());
+		fmt_char(&fmt, '\n');
+		return APP_DUMP_LINE;
+	}
+
+	uint32_t bit = row / (2 + SCHEDULER_STATS_BUCKETS);
+	uint32_t sub = row % (2 + SCHEDULER_STATS_BUCKETS);
+	uint32_t cycles_per_us = CMU_ClockFreqGet(cmuClock_CORE) / 1000000;
+
+	if (bit >= SCHEDULER_EVENTS)
+		return APP_DUMP_DONE;
+	const SCHEDULER_STATS_STRUCT * stats = get_scheduler_stats(1u << bit);
+	if (!stats -> runtime.count)
+		return APP_DUMP_SKIP;
+
+	if (sub < 2)
+	{
+		const SCHEDULER_TIMING_STRUCT * t = sub ? &stats -> runtime : &stats -> delay;
+		fmt_char(&fmt, 'E');
+		fmt_uint(&fmt, bit);
+		fmt_str(&fmt, sub ? " r " : " d ");
+		fmt_uint(&fmt, t -> count);
+		fmt_char(&fmt, ' ');
+		fmt_uint(&fmt, t -> min / cycles_per_us);
+		fmt_char(&fmt, '/');
+		fmt_uint(&fmt, (uint32_t)(t -> sum / t -> count) / cycles_per_us);
+		fmt_char(&fmt, '/');
+		fmt_uint(&fmt, t -> max / cycles_per_us);
+		fmt_str(&fmt, "us\n");
+		return APP_DUMP_LINE;
+	}
+
+	uint32_t bucket = sub - 2;
+	if (!stats -> delay.hist[bucket] && !stats -> runtime.hist[bucket])
+		return APP_DUMP_SKIP;
+	fmt_char(&fmt, 'E');
+	fmt_uint(&fmt, bit);
+	fmt_str(&fmt, " h");
+	fmt_uint(&fmt, bucket);
+	fmt_char(&fmt, ' ');
+	fmt_uint(&fmt, stats -> delay.hist[bucket]);
+	fmt_char(&fmt, ' ');
+	fmt_uint(&fmt, stats -> runtime.hist[bucket]);
+	fmt_char(&fmt, '\n');
+	return APP_DUMP_LINE;
+}
+#endif
+
+/**
+ * @brief
+ *	Formats one row of the APP_CMD_SLEEP dump
+ * @details
+ *	One row per energy mode, as time spent in ms and in tenths of a percent, then one
+ *	row per sleep block held, as energy mode and owner, then one row per IRQ that has
+ *	woken the core, as its IRQn and wake-up count
+ **/
+static app_dump_t app_sleep_row(uint32_t row, char * line, size_t size)
+{
+	FMT_STRUCT fmt;
+
+	fmt_init(&fmt, line, size);
+	if (row < MAX_ENERGY_MODES)
+	{
+		uint32_t total = 0;
+		for (int i = 0; i < MAX_ENERGY_MODES; i++)
+			total += sleep_residency_ticks(i);
+		uint32_t ticks = sleep_residency_ticks(row);
+		uint32_t permille = total ? (uint32_t)(((uint64_t)ticks * 1000) / total) : 0;
+		fmt_str(&fmt, "EM");
+		fmt_uint(&fmt, row);
+		fmt_char(&fmt, ' ');
+		fmt_uint(&fmt, (uint32_t)(((uint64_t)ticks * 1000) / SOFT_TIMER_HZ));
+		fmt_str(&fmt, "ms ");
+		fmt_fixed(&fmt, permille, 1);
+		fmt_str(&fmt, "%\n");
+		return APP_DUMP_LINE;
+	}
+
+	row -= MAX_ENERGY_MODES;
+	if (row < MAX_ENERGY_MODES * SLEEP_OWNER_COUNT)
+	{
+		uint32_t em = row / SLEEP_OWNER_COUNT;
+		sleep_owner_t owner = row % SLEEP_OWNER_COUNT;
+		if (!(sleep_block_owners(em) & (1u << owner)))
+			return APP_DUMP_SKIP;
+		fmt_str(&fmt, "EM");
+		fmt_uint(&fmt, em);
+		fmt_str(&fmt, " blk ");
+		fmt_str(&fmt, sleep_owner_name(owner));
+		fmt_char(&fmt, '\n');
+		return APP_DUMP_LINE;
+	}
+
+	uint32_t irq = row - MAX_ENERGY_MODES * SLEEP_OWNER_COUNT;
+	if (irq >= SLEEP_IRQ_COUNT)
+		return APP_DUMP_DONE;
+	if (!sleep_wakeup_count(irq))
+		return APP_DUMP_SKIP;
+	fmt_str(&fmt, "IRQ");
+	fmt_uint(&fmt, irq);
+	fmt_char(&fmt, ' ');
+	fmt_uint(&fmt, sleep_wakeup_count(irq));
+	fmt_char(&fmt, '\n');
+	return APP_DUMP_LINE;
+}
+
+/**
+ * @brief
+ *	Hibernates until the next sample, if the sample period is long enough
+ * @details
+ *	Only hibernates once the last sample has been sent: no events pending, the BLE TX
+ *	queue empty, no dump in progress, no reading waiting for a connection, and no I2C
+ *	transfer or Si7021 conversion in flight. The RTCC compare for the sample timer wakes
+ *	the part from EM4H, see scheduled_boot_up_evt().
+ *	The HM-10 STATE pin cannot wake the part from EM4H, and neither the held BLE queue nor
+ *	the sample log is retained, so the part stays out of EM4H while disconnected with
+ *	anything left to report.
+ * @note
+ *	LEUART RX is off in EM4H, so BLE commands are ignored while hibernating
+ **/
+static void app_hibernate_check(void)
+{
+	if (sample_period_ms < HIBERNATE_MIN_MS)
+		return;
+	if (get_scheduled_events() || !ble_tx_idle() || dump_row || sample_unsent)
+		return;
+	if (i2c_busy(I2C0) || i2c_busy(I2C1) || si7021_busy())
+		return;
+
+	APP_RETAINED_STRUCT retained;
+	retained.temp_mode = temperatureMode;
+	retained.sample_count = sample_count;
+	retained.sample_period_ms = sample_period_ms;
+	retained.temp_threshold = temp_threshold;
+	for (int i = 0; i < MAX_ENERGY_MODES; i++)
+		retained.residency[i] = sleep_residency_ticks(i);
+	retained.hibernate_tick = soft_timer_now();
+	hibernate_enter(&retained, sizeof(retained));
+}
+
+/**
+ * @brief
+ *	Console handlers for APP_CMD_TEMPK, APP_CMD_TEMPF and APP_CMD_TEMPC
+ **/
+static bool app_cmd_tempK(console_value_t arg)
+{
+	(void)arg;
+	temperatureMode = degreesK;
+	return true;
+}
+static bool app_cmd_tempF(console_value_t arg)
+{
+	(void)arg;
+	temperatureMode = degreesF;
+	return true;
+}
+static bool app_cmd_tempC(console_value_t arg)
+{
+	(void)arg;
+	temperatureMode = degreesC;
+	return true;
+}
+
+/**
+ * @brief
+ *	Console handler for APP_CMD_UNIT
+ * @param[in] arg
+ *	'K', 'F' or 'C'
+ **/
+static bool app_cmd_unit(console_value_t arg)
+{
+	switch (arg.chr)
+	{
+		case 'K':
+			temperatureMode = degreesK;
+			return true;
+		case 'F':
+			temperatureMode = degreesF;
+			return true;
+		case 'C':
+			temperatureMode = degreesC;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * @brief
+ *	Console handler for APP_CMD_RATE
+ * @details
+ *	Restarts the sample timer with the new period, the next sample is one period away
+ * @param[in] arg
+ *	sample period in ms, SAMPLE_PER_MIN_MS to SAMPLE_PER_MAX_MS
+ **/
+static bool app_cmd_rate(console_value_t arg)
+{
+	if (arg.uint < SAMPLE_PER_MIN_MS || arg.uint > SAMPLE_PER_MAX_MS)
+		return false;
+	sample_period_ms = arg.uint;
+	soft_timer_start(SAMPLE_TIMER, SOFT_TIMER_MS(sample_period_ms), SOFT_TIMER_MS(sample_period_ms), SAMPLE_TIMER_EVT);
+	return true;
+}
+
+/**
+ * @brief
+ *	Console handler for APP_CMD_THRESH
+ * @param[in] arg
+ *	LED1 threshold in hundredths of a degree Fahrenheit
+ **/
+static bool app_cmd_thresh(console_value_t arg)
+{
+	app_threshold(arg.centi);
+	return true;
+}
+
+#ifdef SCHEDULER_STATS_ENABLED
+/**
+ * @brief
+ *	Console handler for APP_CMD_STATS
+ **/
+static bool app_cmd_stats(console_value_t arg)
+{
+	(void)arg;
+	app_dump_start(app_stats_row);
+	return true;
+}
+#endif
+
+/**
+ * @brief
+ *	Console handler for APP_CMD_SLEEP
+ **/
+static bool app_cmd_sleep(console_value_t arg)
+{
+	(void)arg;
+	app_dump_start(app_sleep_row);
+	return true;
+}
+
+/**
+ * @brief
+ *	Console handler for APP_CMD_LOG
+ **/
+static bool app_cmd_log(console_value_t arg)
+{
+	(void)arg;
+	app_dump_start(app_log_row);
+	return true;
+}
+
+/**
+ * @brief
+ *	Registers the app's console commands
+ **/
+static void app_console_open(void)
+{
+	console_register(APP_CMD_TEMPK, CONSOLE_ARG_NONE, app_cmd_tempK);
+	console_register(APP_CMD_TEMPF, CONSOLE_ARG_NONE, app_cmd_tempF);
+	console_register(APP_CMD_TEMPC, CONSOLE_ARG_NONE, app_cmd_tempC);
+	console_register(APP_CMD_UNIT, CONSOLE_ARG_CHAR, app_cmd_unit);
+	console_register(APP_CMD_RATE, CONSOLE_ARG_UINT, app_cmd_rate);
+	console_register(APP_CMD_THRESH, CONSOLE_ARG_CENTI, app_cmd_thresh);
+#ifdef SCHEDULER_STATS_ENABLED
+	console_register(APP_CMD_STATS, CONSOLE_ARG_NONE, app_cmd_stats);
+#endif
+	console_register(APP_CMD_SLEEP, CONSOLE_ARG_NONE, app_cmd_sleep);
+	console_register(APP_CMD_LOG, CONSOLE_ARG_NONE, app_cmd_log);
+}
 
 /**
  * @brief
  *	Set up the peripherals.
  *
  * @details
- *	Calls open functions for the following: CMU, GPIO, LETIMER (PWM).
+ *	Registers the scheduled event handlers, and calls open functions for the following: CMU, GPIO, LETIMER (PWM),
+ *	soft timers (RTCC).
+ *	On a wake-up from EM4H the LETIMER is left off, it is only used for the PWM demo.
  *
  * @note
  *	This function does call other app functions, used to open some of the peripherals.
@@ -34,11 +508,39 @@ void app_peripheral_setup(void)
 {
 	sleep_open();
 	scheduler_open();
+	ring_init(&sample_log, sample_log_buf, APP_LOG_SIZE);
+	app_threshold(TEMP_THRESHOLD);
+	console_open();
+	app_console_open();
+	scheduler_register_event(LETIMER0_UF_EVT, scheduled_letimer0_uf_evt);
+	scheduler_register_event(LETIMER0_COMP0_EVT, scheduled_letimer0_comp0_evt);
+	scheduler_register_event(LETIMER0_COMP1_EVT, scheduled_letimer0_comp1_evt);
+	scheduler_register_event(I2C_SI7021_EVT, scheduled_i2c_si7021_evt);
+	scheduler_register_event(LEUART_RX_DONE_EVT, scheduled_leuart_rx_done_evt);
+	scheduler_register_event(LEUART_TX_DONE_EVT, scheduled_leuart_tx_done_evt);
+	scheduler_register_event(SAMPLE_TIMER_EVT, scheduled_sample_timer_evt);
+	scheduler_register_event(BLE_AT_TIMEOUT_EVT, scheduled_ble_at_timeout_evt);
+	scheduler_register_event(BLE_AT_DONE_EVT, scheduled_ble_at_done_evt);
+	scheduler_register_event(HM10_STATE_EVT, scheduled_hm10_state_evt);
+	scheduler_register_event(HM10_LINK_EVT, scheduled_hm10_link_evt);
+	scheduler_register_event(SI7021_READ_EVT, scheduled_si7021_read_evt);
+	scheduler_register_event(BOOT_UP_EVT, scheduled_boot_up_evt);
 	cmu_open();
 	gpio_open();
-	app_letimer_pwm_open(PWM_PER, PWM_ACT_PER);
-	si7021_i2c_open();
+	soft_timer_open();
+	sleep_stats_reset();
+	hibernate_open();
+	if (!hibernate_resumed())
+		app_letimer_pwm_open(PWM_PER, PWM_ACT_PER);
+	si7021_i2c_open(SI7021_TIMER, SI7021_READ_EVT);
 	ble_open(LEUART_TX_DONE_EVT, LEUART_RX_DONE_EVT);
+	ble_at_open(BLE_AT_TIMER, BLE_AT_TIMEOUT_EVT, BLE_AT_DONE_EVT);
+	if (BLE_LINK_GATING)
+	{
+		// interrupt first, then the handler reads the pin, so no edge falls in between
+		gpio_int_open(HM10_STATE_PORT, HM10_STATE_PIN, HM10_STATE_EVT);
+		add_scheduled_event(HM10_STATE_EVT);
+	}
 	add_scheduled_event(BOOT_UP_EVT);
 }
 
@@ -92,110 +594,209 @@ void app_letimer_pwm_open(float period, float act_period)
  **/
 void scheduled_letimer0_uf_evt(void)
 {
-	EFM_ASSERT(get_scheduled_events() & LETIMER0_UF_EVT);
-	remove_scheduled_event(LETIMER0_UF_EVT);
-
 	si7021_i2c_start();
 }
 /**
  * @brief
  *	Scheduled Event Handler for LETIMER0 COMP0
  * @details
- *	Removes event from scheduler, asserts false
+ *	Asserts false
  * @note
  *	Contains EFM_ASSERT(false), as we shouldn't end up in this method
  **/
 void scheduled_letimer0_comp0_evt(void)
 {
-//	EFM_ASSERT(get_scheduled_events() & LETIMER0_COMP0_EVT);
-	remove_scheduled_event(LETIMER0_COMP0_EVT);
 	EFM_ASSERT(false);
 }
 /**
  * @brief
  *	Scheduled Event Handler for LETIMER0 COMP1
  * @details
- *	Removes event from scheduler, asserts false
+ *	Asserts false
  * @note
  *	Contains EFM_ASSERT(false), as we shouldn't end up in this method
  **/
 void scheduled_letimer0_comp1_evt(void)
 {
-//	EFM_ASSERT(get_scheduled_events() & LETIMER0_COMP1_EVT);
-	remove_scheduled_event(LETIMER0_COMP1_EVT);
 	EFM_ASSERT(false);
 }
 /**
  * @brief
  * 	Scheduled Event Handler for I2C SI7021
  * @details
- * 	Removes event from the scheduler, checks temperature and compares it to TEMP_THRESHOLD
+ * 	Drains every queued Si7021 reading, logs it to sample_log, reports it over BLE and
+ * 	compares it to temp_threshold, as the raw reading temp_threshold_raw
+ * 	Readings whose transaction the Si7021 NACKed are dropped
+ * @note
+ * 	While no phone is connected readings are only logged, scheduled_hm10_state_evt()
+ * 	reports them on the next connection
  **/
 void scheduled_i2c_si7021_evt(void)
 {
-	EFM_ASSERT(get_scheduled_events() & I2C_SI7021_EVT);
-	remove_scheduled_event(I2C_SI7021_EVT);
+	SCHEDULER_RECORD_STRUCT sample;
 
-	char tempToPrint[32];
-	float temp;
-
-	switch (temperatureMode)
+	while (pop_scheduled_event(I2C_SI7021_EVT, &sample))
 	{
-		case degreesK:
-			temp = si7021_temp_K();
-			break;
-		case degreesF:
-			temp = si7021_temp_F();
-			break;
-		case degreesC:
-			temp = si7021_temp_C();
-			break;
-		default:
-			EFM_ASSERT(false);
-			break;
-	}
+		char tempToPrint[32];
+		uint16_t raw = (uint16_t)sample.payload;
+		uint8_t logged[2] = { raw & 0xFF, raw >> 8 };
+		SI7021_SAMPLE_STRUCT reading;
+
+		if ((sample.payload >> I2C_PAYLOAD_STATUS_SHIFT) != I2C_STATUS_OK)
+			continue;	// the Si7021 did not answer, skip this sample
+		sample_count++;
 
-	int leftDec = (int)temp;
-	int rightDec = ((int)(temp * 100.0)) % 100;
-	sprintf(tempToPrint, "%d.%d %c\n", leftDec, rightDec, (temperatureMode == degreesC)?'C':(temperatureMode == degreesF)?'F':(temperatureMode == degreesK)?'K':'?');
-	ble_write(tempToPrint);
+		if (ring_space(&sample_log) < sizeof(logged))
+			ring_read(&sample_log, NULL, sizeof(logged));
+		ring_write(&sample_log, logged, sizeof(logged));
 
-	if (si7021_temp_F() >= TEMP_THRESHOLD)
-		GPIO_PinOutSet(LED1_port, LED1_pin);
-	else
-		GPIO_PinOutClear(LED1_port, LED1_pin);
+		if (ble_connected())
+		{
+			si7021_sample(raw, &reading);
+			app_format_temp(&reading, tempToPrint, sizeof(tempToPrint));
+			ble_write_telemetry(tempToPrint);
+		}
+		else if (sample_unsent < APP_LOG_SIZE / 2)
+			sample_unsent++;
+
+		if (raw >= temp_threshold_raw)
+			GPIO_PinOutSet(LED1_port, LED1_pin);
+		else
+			GPIO_PinOutClear(LED1_port, LED1_pin);
+	}
 }
 /**
  * @brief
  * 	Scheduled Event Handler for LEUART upon completion of RX
  * @details
- * 	Removes event from the scheduler
+ * 	Hands every received command to console_dispatch(), a command may arrive while the
+ * 	last one is still waiting to be handled
  **/
 void scheduled_leuart_rx_done_evt(void)
 {
-	remove_scheduled_event(LEUART_RX_DONE_EVT);
+	char * rxstr;
 
-	char * rxstr = ble_getCMD();
-
-	if (!strcmp(rxstr, APP_CMD_TEMPK))
-		temperatureMode = degreesK;
-	else if (!strcmp(rxstr, APP_CMD_TEMPF))
-		temperatureMode = degreesF;
-	else if (!strcmp(rxstr, APP_CMD_TEMPC))
-		temperatureMode = degreesC;
-	else
-		ble_write("unknown cmd!\n");
+	while ((rxstr = ble_getCMD()))
+	{
+		switch (console_dispatch(rxstr))
+		{
+			case CONSOLE_OK:
+				break;
+			case CONSOLE_BAD_ARG:
+				ble_write("bad arg!\n");
+				break;
+			default:
+				ble_write("unknown cmd!\n");
+				break;
+		}
+	}
 }
 /**
  * @brief
  * 	Scheduled Event Handler for LEUART upon completion of TX
  * @details
- * 	Removes event from the scheduler
+ * 	Starts transmitting the next string in the BLE circular buffer, if any, and
+ * 	continues a BLE dump in progress, then hibernates if there is nothing left to do
  **/
 void scheduled_leuart_tx_done_evt(void)
 {
 	ble_circ_pop(false);
-	remove_scheduled_event(LEUART_TX_DONE_EVT);
+	app_dump_continue();
+	app_hibernate_check();
+}
+/**
+ * @brief
+ * 	Scheduled Event Handler for the sample soft timer
+ * @details
+ * 	Starts a Si7021 temperature reading, the result comes back as I2C_SI7021_EVT
+ * @note
+ * 	SAMPLE_TIMER replaces LETIMER0 UF as the sampling heartbeat, LETIMER0 is left
+ * 	configured (for PWM on LED0) but is not started
+ **/
+void scheduled_sample_timer_evt(void)
+{
+	si7021_i2c_start();
+}
+/**
+ * @brief
+ * 	Scheduled Event Handler for the end of the Si7021 conversion wait
+ * @details
+ * 	Reads the reading off the Si7021, it comes back as I2C_SI7021_EVT
+ **/
+void scheduled_si7021_read_evt(void)
+{
+	si7021_read();
+}
+/**
+ * @brief
+ * 	Scheduled Event Handler for the HM-10 AT response timeout
+ * @details
+ * 	Ends the AT exchange, it reports the failure with BLE_AT_DONE_EVT
+ **/
+void scheduled_ble_at_timeout_evt(void)
+{
+	ble_at_timeout();
+}
+/**
+ * @brief
+ * 	Scheduled Event Handler for the end of an HM-10 AT exchange
+ * @details
+ * 	Reports the result over BLE, the payload is 0 on success or the number of the AT
+ * 	command that was not answered
+ **/
+void scheduled_ble_at_done_evt(void)
+{
+	SCHEDULER_RECORD_STRUCT result;
+	char line[BLE_STR_SIZE];
+	FMT_STRUCT fmt;
+
+	while (pop_scheduled_event(BLE_AT_DONE_EVT, &result))
+	{
+		fmt_init(&fmt, line, sizeof(line));
+		if (result.payload)
+		{
+			fmt_str(&fmt, "AT ");
+			fmt_uint(&fmt, result.payload);
+			fmt_str(&fmt, " failed\n");
+		}
+		else
+			fmt_str(&fmt, "AT config done\n");
+		ble_write(line);
+	}
+}
+/**
+ * @brief
+ * 	Scheduled Event Handler for a HM-10 STATE pin edge
+ * @details
+ * 	A low pin drops the link right away. A high pin only starts HM10_LINK_TIMER: the
+ * 	link comes up in scheduled_hm10_link_evt() if the pin is still high, so a blinking
+ * 	STATE pin never reads as a connection.
+ **/
+void scheduled_hm10_state_evt(void)
+{
+	if (!GPIO_PinInGet(HM10_STATE_PORT, HM10_STATE_PIN))
+	{
+		soft_timer_stop(HM10_LINK_TIMER);
+		remove_scheduled_event(HM10_LINK_EVT);
+		ble_link(false);
+	}
+	else if (!ble_connected() && !soft_timer_active(HM10_LINK_TIMER))
+		soft_timer_start(HM10_LINK_TIMER, SOFT_TIMER_MS(HM10_LINK_SETTLE_MS), 0, HM10_LINK_EVT);
+}
+/**
+ * @brief
+ * 	Scheduled Event Handler for the end of the HM-10 STATE settle time
+ * @details
+ * 	Brings the link up with ble_link(), which flushes the BLE queue, then reports the
+ * 	readings logged while no phone was connected
+ **/
+void scheduled_hm10_link_evt(void)
+{
+	if (!GPIO_PinInGet(HM10_STATE_PORT, HM10_STATE_PIN))
+		return;
+	ble_link(true);
+	if (sample_unsent)
+		app_dump_start(app_backlog_row);
 }
 /**
  * @brief
@@ -203,19 +804,58 @@ void scheduled_leuart_tx_done_evt(void)
  * @details
  * 	This event is only called once, during boot up, and serves to setup anything we need for the device
  * @note
- * 	The call to ble_test() only needs to happen once, and then it is commented out
+ * 	The HM-10 only needs configuring once, so ble_configure() is only built in with
+ * 	BLE_AT_CONFIG_ENABLED. It runs after the TDD routines, in the background.
+ * 	On a wake-up from EM4H the retained state is restored, the time hibernated counts as
+ * 	EM4 residency, and the TDD routines and banner are skipped: the wake-up is the sample
+ * 	timer's deadline, so a sample is started right away.
  **/
 void scheduled_boot_up_evt(void)
 {
-	remove_scheduled_event(BOOT_UP_EVT);
-	#ifdef BLE_TEST_ENABLED
-		EFM_ASSERT(ble_test("WA-PG12"));
-		for (int i = 0; i < 20000000; i++);
-	#endif
+	APP_RETAINED_STRUCT retained;
+
+	if (hibernate_restore(&retained, sizeof(retained)))
+	{
+		temperatureMode = retained.temp_mode;
+		sample_count = retained.sample_count;
+		sample_period_ms = retained.sample_period_ms;
+		app_threshold(retained.temp_threshold);
+		sleep_residency_restore(retained.residency, soft_timer_now() - retained.hibernate_tick);
+		add_scheduled_event(SAMPLE_TIMER_EVT);
+		soft_timer_start(SAMPLE_TIMER, SOFT_TIMER_MS(sample_period_ms), SOFT_TIMER_MS(sample_period_ms), SAMPLE_TIMER_EVT);
+		return;
+	}
+
+	char bench[BLE_STR_SIZE];
+	FMT_STRUCT fmt;
+	uint32_t ring_cycles = ring_test();
+	uint32_t fmt_cycles = fmt_test();
 	circular_buff_test();
 	ble_rx_test();
+	console_test();
 
 	ble_write("\nBLE TDD passed!\n");
+	fmt_init(&fmt, bench, sizeof(bench));
+	fmt_str(&fmt, "ring ");
+	fmt_uint(&fmt, ring_cycles);
+	fmt_str(&fmt, " cyc/");
+	fmt_uint(&fmt, RING_BENCH_BYTES);
+	fmt_str(&fmt, "B\n");
+	ble_write(bench);
+	fmt_init(&fmt, bench, sizeof(bench));
+	fmt_str(&fmt, "fmt ");
+	fmt_uint(&fmt, fmt_cycles);
+	#ifdef FMT_BENCH_SNPRINTF
+		fmt_str(&fmt, " printf ");
+		fmt_uint(&fmt, fmt_bench_snprintf());
+	#endif
+	fmt_str(&fmt, " cyc/");
+	fmt_uint(&fmt, FMT_BENCH_LINES);
+	fmt_str(&fmt, "L\n");
+	ble_write(bench);
 	ble_write("WAbrams\n");
-	letimer_start(LETIMER0, true);
+	#ifdef BLE_AT_CONFIG_ENABLED
+		EFM_ASSERT(ble_configure(BLE_MOD_NAME));
+	#endif
+	soft_timer_start(SAMPLE_TIMER, SOFT_TIMER_MS(sample_period_ms), SOFT_TIMER_MS(sample_period_ms), SAMPLE_TIMER_EVT);
 }
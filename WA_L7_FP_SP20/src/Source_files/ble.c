@@ -11,13 +11,34 @@
 
 #include "ble.h"
 #include "leuart.h"
+#include "console.h"
+#include "scheduler.h"
+#include "soft_timer.h"
+#include "fmt.h"
 #include <string.h>
-#include <stdio.h>
 
 static BLE_CIRCULAR_BUF ble_cbuf;				/**< circular buffer struct for ble.c **/
 static CIRC_TEST_STRUCT test_struct;			/**< circular buffer test struct for the TDD routine **/
-static char ble_tx_string[BLE_STR_SIZE];		/**< ble string currently being transmitted by LEUART **/
-static char ble_rx_string[(BLE_STR_SIZE / 2)];  /**< ble string currently being received **/
+static uint32_t ble_tx_inflight;				/**< bytes LEUART is sending from ble_cbuf, 0 if none **/
+static uint32_t ble_tx_inflight_packets;		/**< packets coalesced into the transfer in flight **/
+static ble_policy_t ble_policy;					/**< what ble_circ_push() does when ble_cbuf is full **/
+static uint32_t ble_drop_count;					/**< packets dropped or rejected since ble_open() **/
+static char ble_rx_string[(BLE_STR_SIZE / 2)];  /**< last command popped off ble_rx_ring, see ble_getCMD() **/
+static uint8_t ble_rx_buf[BLE_RX_SIZE];			/**< storage for ble_rx_ring **/
+static RING_STRUCT ble_rx_ring;					/**< received command frames, produced by the LEUART IRQ handler **/
+static uint32_t ble_rx_reject_count;			/**< commands rejected for not fitting in ble_rx_string since ble_open() **/
+static bool ble_link_up;						/**< a phone is connected to the HM-10, see ble_link() **/
+
+static BLE_AT_STRUCT ble_at_queue[BLE_AT_QUEUE];	/**< AT commands of the exchange, ble_at_head is pending **/
+static uint32_t ble_at_head;					/**< index of the pending AT command **/
+static uint32_t ble_at_count;					/**< AT commands left in the exchange **/
+static uint32_t ble_at_step;					/**< AT commands answered so far in the exchange **/
+static ble_at_state_t ble_at_state;				/**< AT engine state **/
+static char ble_at_rx[BLE_AT_LEN * 2];			/**< bytes received for the pending AT command **/
+static uint32_t ble_at_rxlen;					/**< length of ble_at_rx **/
+static uint32_t ble_at_timer;					/**< soft timer id for the AT timeouts **/
+static uint32_t ble_at_timeout_evt;				/**< scheduled event id for an AT timeout **/
+static uint32_t ble_at_done_evt;				/**< scheduled event id for the end of an AT exchange **/
 
 static uint32_t ble_tx_done_evt;				/**< scheduled event id for ble tx done **/
 static uint32_t ble_rx_done_evt;				/**< scheduled event id for ble rx done **/
@@ -26,55 +47,157 @@ static uint32_t ble_rx_done_evt;				/**< scheduled event id for ble rx done **/
  * @brief
  * 	checks if the circular buffer ble_cbuf is empty
  * @details
- *	compares the read and write indeces, if they are equal the buffer is empty
+ *	checks the length ring, if it holds no length entries the buffer is empty
+ * @note
+ *	an empty packet has no body, so the body ring alone cannot tell
 **/
 static inline bool ble_circ_isEmpty(void)
 {
-	return (ble_cbuf.read_ptr == ble_cbuf.write_ptr);
+	return ring_count(&ble_cbuf.lens) == 0;
+}
+/**
+ * @brief
+ * 	returns the number of queued packets, including the ones in flight
+**/
+static inline uint32_t ble_circ_count(void)
+{
+	return ring_count(&ble_cbuf.lens) / 2;
 }
 /**
  * @brief
- * 	checks the amount of free space in the circular buffer
+ * 	returns the length entry of a queued packet
  * @details
- *	gets the difference between write and read indeces, wraps them to a valid value (0, size), and returns size - occupied
- * @note
- *  does not account for the "bubble" due to the architecture limitation, so will always stop at 1.
+ * 	entries are 16 bit, little endian: BLE_LEN_MASK holds the length, BLE_LEN_TELEMETRY
+ * 	the telemetry mark
+ * @param[in] packet
+ * 	position in the queue, 0 is the oldest
+**/
+static inline uint32_t ble_circ_entry(uint32_t packet)
+{
+	return *ring_read_at(&ble_cbuf.lens, 2 * packet) | (*ring_read_at(&ble_cbuf.lens, 2 * packet + 1) << 8);
+}
+/**
+ * @brief
+ * 	returns the length of a queued packet
+ * @param[in] packet
+ * 	position in the queue, 0 is the oldest
+**/
+static inline uint32_t ble_circ_len(uint32_t packet)
+{
+	return ble_circ_entry(packet) & BLE_LEN_MASK;
+}
+/**
+ * @brief
+ * 	checks if a packet body fits in the circular buffer
+ * @param[in] len
+ * 	length of the packet body
 **/
-static inline uint32_t ble_circ_space(void)
+static inline bool ble_circ_fits(uint32_t len)
 {
-	return CSIZE - ((ble_cbuf.write_ptr - ble_cbuf.read_ptr) & ble_cbuf.size_mask);
+	return len <= ring_space(&ble_cbuf.body) && ring_space(&ble_cbuf.lens) >= 2;
 }
 /**
  * @brief
- * 	updates the circular buffer's write index safely
+ * 	works out which queued packets the overflow policy would drop for a new packet
  * @details
- * 	adds update_by to index_struct's write_ptr and then masks it to not oob
- * @note
- * 	bypasses modulo math by using bitwise and with the mask
+ * 	BLE_DROP_OLDEST takes the oldest packets not in flight until the new one fits,
+ * 	BLE_OVERWRITE_TELEMETRY takes the newest queued telemetry packet. Nothing is removed
+ * 	here, so a packet that cannot fit even after every allowed removal costs no queued
+ * 	packets.
+ * @param[in] len
+ * 	length of the new packet body
+ * @param[in] telemetry
+ * 	the new packet is telemetry
+ * @param[out] first
+ * 	position of the first packet to drop
+ * @returns
+ * 	number of packets to drop from first on, or -1 if the new packet cannot fit
 **/
-static inline void update_circ_wrtindex(BLE_CIRCULAR_BUF * index_struct, uint32_t update_by)
+static int32_t ble_circ_plan(uint32_t len, bool telemetry, uint32_t * first)
 {
-	index_struct -> write_ptr = (index_struct -> write_ptr + update_by) & index_struct -> size_mask;
+	uint32_t count = ble_circ_count();
+	uint32_t body = ring_space(&ble_cbuf.body);
+	uint32_t lens = ring_space(&ble_cbuf.lens);
+	uint32_t drops = 0;
+
+	*first = ble_tx_inflight_packets;
+	if (ble_policy == BLE_DROP_OLDEST)
+	{
+		while ((len > body || lens < 2) && *first + drops < count)
+		{
+			body += ble_circ_len(*first + drops);
+			lens += 2;
+			drops++;
+		}
+	}
+	else if (ble_policy == BLE_OVERWRITE_TELEMETRY && telemetry)
+	{
+		for (uint32_t i = count; i > ble_tx_inflight_packets; i--)
+		{
+			if (ble_circ_entry(i - 1) & BLE_LEN_TELEMETRY)
+			{
+				*first = i - 1;
+				body += ble_circ_len(i - 1);
+				lens += 2;
+				drops = 1;
+				break;
+			}
+		}
+	}
+	return (len <= body && lens >= 2) ? (int32_t)drops : -1;
 }
 /**
  * @brief
- * 	updates the circular buffer's read index safely
+ * 	removes a queued packet from the circular buffer
  * @details
- * 	adds update_by to index_struct's read_ptr and then masks it to not oob
+ * 	moves the bodies and lengths of every newer packet back over it, then unwrites the
+ * 	freed bytes from the head of both rings
  * @note
- * 	bypasses modulo math by using bitwise and with the mask
+ * 	must not be called on a packet that is in flight. Only ever runs in main context, as
+ * 	both rings are produced and consumed there.
+ * @param[in] packet
+ * 	position in the queue, 0 is the oldest
 **/
-static inline void update_circ_readindex(BLE_CIRCULAR_BUF * index_struct, uint32_t update_by)
+static void ble_circ_remove(uint32_t packet)
 {
-	index_struct -> read_ptr = (index_struct -> read_ptr + update_by) & index_struct -> size_mask;
+	uint32_t count = ble_circ_count();
+	uint32_t total = ring_count(&ble_cbuf.body);
+	uint32_t start = 0;
+	uint32_t len = ble_circ_len(packet);
+
+	EFM_ASSERT(packet >= ble_tx_inflight_packets && packet < count);
+	for (uint32_t i = 0; i < packet; i++)
+		start += ble_circ_len(i);
+	for (uint32_t i = start; i + len < total; i++)
+		*ring_read_at(&ble_cbuf.body, i) = *ring_read_at(&ble_cbuf.body, i + len);
+	ring_unwrite(&ble_cbuf.body, len);
+
+	for (uint32_t i = 2 * packet; i + 2 < 2 * count; i++)
+		*ring_read_at(&ble_cbuf.lens, i) = *ring_read_at(&ble_cbuf.lens, i + 2);
+	ring_unwrite(&ble_cbuf.lens, 2);
+	ble_drop_count++;
 }
 
 
+/**
+ * @brief
+ * 	console handler for BLE_CMD_POLICY
+ * @param[in] arg
+ * 	overflow policy, see ble_policy_t
+**/
+static bool ble_cmd_policy(console_value_t arg)
+{
+	if (arg.uint > BLE_OVERWRITE_TELEMETRY)
+		return false;
+	ble_overflow_policy(arg.uint);
+	return true;
+}
+
 /**
  * @brief
  *	sets up BLE to control LEUART for the HM10 module
  * @details
- *	initializes circular buffer and HM10_LEUART
+ *	initializes circular buffer and HM10_LEUART, and registers the BLE console commands
  * @param[in] tx_event
  *	scheduler event ID for transmit complete
  * @param[in] rx_event
@@ -84,6 +207,10 @@ void ble_open(uint32_t tx_event, uint32_t rx_event)
 {
 	ble_rx_done_evt = rx_event;
 	ble_tx_done_evt = tx_event;
+	ble_policy = BLE_OVERFLOW_POLICY;
+	ble_drop_count = 0;
+	ble_rx_reject_count = 0;
+	ble_link_up = !BLE_LINK_GATING;
 
 	LEUART_OPEN_STRUCT leuart_open_s;
 	// LEUART INIT STRUCT fields
@@ -108,221 +235,504 @@ void ble_open(uint32_t tx_event, uint32_t rx_event)
 	leuart_open_s.startframe = HM10_STARTF;
 	leuart_open_s.rxdatav_en = true;
 	leuart_open_s.sigframe = HM10_SIGF;
-	// LEUART RX STRING
-	leuart_open_s.rxlen = BLE_STR_SIZE / 2;
-	leuart_open_s.rxstring = ble_rx_string;
+	// LEUART RX RING
+	ring_init(&ble_rx_ring, ble_rx_buf, BLE_RX_SIZE);
+	leuart_open_s.rx_ring = &ble_rx_ring;
 	// LEUART DMA
 	leuart_open_s.tx_dma = LEUART_TX_DMA;
+	leuart_open_s.rx_dma = LEUART_RX_DMA;
 	// LEUART SCHEDULED EVENTS
 	leuart_open_s.rx_done_evt = &ble_rx_done_evt;
 	leuart_open_s.tx_done_evt = &ble_tx_done_evt;
 	ble_circ_init();
 	leuart_open(HM10_LEUART0, &leuart_open_s);
+	console_register(BLE_CMD_POLICY, CONSOLE_ARG_UINT, ble_cmd_policy);
 }
 
 /**
  * @brief
  *	Starts a write to the BLE (HM-10) device
  * @details
- *	Uses input string to call leuart_start(), which begins transmitting the string if LEUART is not already transmitting
+ *	Queues the input string, and starts transmitting if LEUART is not already transmitting
+ * @note
+ *	Never blocks: if the circular buffer is full the overflow policy decides what is
+ *	dropped, see ble_overflow_policy()
  * @param[in] string
  *	input string to be transmitted
+ * @returns
+ *	whether the string was queued, see ble_write_t
  **/
-void ble_write(char * string)
+ble_write_t ble_write(char * string)
 {
-	ble_circ_push(string);
+	ble_write_t result = ble_circ_push(string, false);
 	ble_circ_pop(false);
+	return result;
 }
 
 /**
  * @brief
- *   BLE Test performs two functions.  First, it is a Test Driven Development
- *   routine to verify that the LEUART is correctly configured to communicate
- *   with the BLE HM-18 module.  Second, the input argument passed to this
- *   function will be written into the BLE module and become the new name
- *   advertised by the module while it is looking to pair.
- *
+ *	Starts a write of telemetry to the BLE (HM-10) device
  * @details
- * 	 This global function will use polling functions provided by the LEUART
- * 	 driver for both transmit and receive to validate communications with
- * 	 the HM-18 BLE module.  For the assignment, the communication with the
- * 	 BLE module must use low energy design principles of being an interrupt
- * 	 driven state machine.
- *
- * @note
- *   For this test to run to completion, the phone most not be paired with
- *   the BLE module.  In addition for the name to be stored into the module
- *   a breakpoint must be placed at the end of the test routine and stopped
- *   at this breakpoint while in the debugger for a minimum of 5 seconds.
- *
- * @param[in] *mod_name
- *   The name that will be written to the HM-18 BLE module to identify it
- *   while it is advertising over Bluetooth Low Energy.
- *
- * @return
- *   Returns bool true if successfully passed through the tests in this
- *   function.
+ *	Same as ble_write(), but marks the packet as telemetry: with BLE_OVERWRITE_TELEMETRY
+ *	a full buffer replaces the newest queued telemetry packet, so a slow link reports the
+ *	latest reading instead of stalling on old ones
+ * @param[in] string
+ *	input string to be transmitted
+ * @returns
+ *	whether the string was queued, see ble_write_t
  **/
-bool ble_test(char * mod_name)
+ble_write_t ble_write_telemetry(char * string)
 {
-	uint32_t str_len;
+	ble_write_t result = ble_circ_push(string, true);
+	ble_circ_pop(false);
+	return result;
+}
 
-	__disable_irq();
+/**
+ * @brief
+ *	Selects what ble_write() does when the circular buffer is full
+ * @param[in] policy
+ *	overflow policy, see ble_policy_t
+ **/
+void ble_overflow_policy(ble_policy_t policy)
+{
+	ble_policy = policy;
+}
 
-	// How is polling different than using interrupts?
-	// 	ANSWER: it's a busy / wait instead of being trigged by an interrupt
-	// How does interrupts benefit the system for low energy operation?
-	// 	ANSWER: we can sleep while waiting for interrupts while waiting
-	// How do interrupts benefit the system that has multiple tasks?
-	// 	ANSWER: can work on other things while we wait for an interrupt
+/**
+ * @brief
+ *	Returns the number of packets lost to a full circular buffer
+ * @returns
+ *	packets dropped or rejected since ble_open()
+ **/
+uint32_t ble_drops(void)
+{
+	return ble_drop_count;
+}
+
+/**
+ * @brief
+ *	Returns the number of received commands lost to a full RX ring
+ * @returns
+ *	commands dropped since ble_open()
+ **/
+uint32_t ble_rx_drops(void)
+{
+	return leuart_rx_drops();
+}
 
-	char break_str[80] = "AT";
-	char ok_str[80] = "OK";
+/**
+ * @brief
+ *	Returns the number of received commands too long for ble_rx_string
+ * @returns
+ *	commands rejected by ble_getCMD() since ble_open()
+ **/
+uint32_t ble_rx_rejects(void)
+{
+	return ble_rx_reject_count;
+}
 
-	char output_str[80] = "AT+NAME";
-	char result_str[80] = "OK+Set:";
+/**
+ * @brief
+ * 	checks if everything written with ble_write() has been transmitted
+ * @note
+ * 	packets held while no phone is connected count as not sent, so hibernating never
+ * 	throws them away
+ * @returns
+ * 	true if the circular buffer is empty, LEUART is not transmitting and no AT exchange
+ * 	is running
+ **/
+bool ble_tx_idle(void)
+{
+	return ble_circ_isEmpty() && !leuart_tx_busy(HM10_LEUART0) && ble_at_state == BLE_AT_IDLE;
+}
 
-	char reset_str[80] = "AT+RESET";
-	char reset_result_str[80] = "OK+RESET";
-	char return_str[80];
+/**
+ * @brief
+ * 	updates the connection state of the HM-10
+ * @details
+ * 	while no phone is connected ble_circ_pop() holds the queue, so nothing reaches a
+ * 	module that would only drop it (or read it as an AT command). Connecting flushes
+ * 	whatever was queued meanwhile.
+ * @note
+ * 	ignored without BLE_LINK_GATING, the link is then always up
+ * @param[in] connected
+ * 	true once the HM-10 STATE pin has settled high, false as soon as it drops
+ **/
+void ble_link(bool connected)
+{
+	if (!BLE_LINK_GATING)
+		return;
+	ble_link_up = connected;
+	if (connected)
+		ble_circ_pop(false);
+}
 
-	bool rx_disabled, rx_en, tx_en;
-	uint32_t status;
+/**
+ * @brief
+ * 	checks if a phone is connected to the HM-10
+ * @returns
+ * 	the state last given to ble_link(), always true without BLE_LINK_GATING
+ **/
+bool ble_connected(void)
+{
+	return ble_link_up;
+}
 
-	// These are the routines that will build up the entire command and response
-	// of programming the name into the BLE module.  Concatenating the command or
-	// response with the input argument name
-	strcat(output_str, mod_name);
-	strcat(result_str, mod_name);
+/**
+ * @brief
+ * 	sets up the AT engine for a pending command
+ * @details
+ * 	receives every byte (no RX blocking), with the first and last characters of the
+ * 	expected response as STARTF and SIGF
+ * @param[in] at
+ * 	command whose response to wait for
+**/
+static void ble_at_frame(const BLE_AT_STRUCT * at)
+{
+	leuart_rx_frame(HM10_LEUART0, at -> resp[0], at -> resp[strlen(at -> resp) - 1], false);
+	ble_at_rxlen = 0;
+	ble_at_rx[0] = '\0';
+}
 
-	status = leuart_status(HM10_LEUART0);
-	if (status & LEUART_STATUS_RXBLOCK)
-	{
-		rx_disabled = true;
-		leuart_cmd_write(HM10_LEUART0, LEUART_CMD_RXBLOCKDIS);
-	}
-	else
-		rx_disabled = false;
+/**
+ * @brief
+ * 	sends the pending AT command, once LEUART TX is free
+ * @details
+ * 	called whenever TX may have become idle (ble_circ_pop()) or a command is queued up.
+ * 	Starts the command's timeout on the soft timer, which posts the timeout event.
+**/
+static void ble_at_kick(void)
+{
+	BLE_AT_STRUCT * at = &ble_at_queue[ble_at_head];
 
-	if (status & LEUART_STATUS_RXENS)
-		rx_en = true;
-	else
+	if (ble_at_state != BLE_AT_SEND || ble_tx_inflight_packets || leuart_tx_busy(HM10_LEUART0))
+		return;
+	if (leuart_start(HM10_LEUART0, at -> cmd, strlen(at -> cmd)))
 	{
-		rx_en = false;
-		leuart_cmd_write(HM10_LEUART0, LEUART_CMD_RXEN);
-		while (!(leuart_status(HM10_LEUART0) & LEUART_STATUS_RXENS));
+		ble_at_state = BLE_AT_WAIT;
+		soft_timer_start(ble_at_timer, SOFT_TIMER_MS(at -> timeout_ms), 0, ble_at_timeout_evt);
 	}
+}
 
-	if (status & LEUART_STATUS_TXENS)
-		tx_en = true;
-	else
-	{
-		leuart_cmd_write(HM10_LEUART0, LEUART_CMD_TXEN);
-		while (!(leuart_status(HM10_LEUART0) & LEUART_STATUS_TXENS));
-		tx_en = false;
-	}
-	leuart_cmd_write(HM10_LEUART0, (LEUART_CMD_CLEARRX | LEUART_CMD_CLEARTX));
-
-	// Why is this command required if you want to change the name of the DSD HM10 module?
-	//  ANSWER: it won't listen to commands while connected to the device
-	str_len = strlen(break_str);
-	for (int i = 0; i < str_len; i++)
-		leuart_app_transmit_byte(HM10_LEUART0, break_str[i]);
-
-	// What will the ble module response back to this command if there is a current ble connection?
-	// 	ANSWER: either OK or OK+LOST (if AT+NOTI = 1)
-	str_len = strlen(ok_str);
-	for (int i = 0; i < str_len; i++)
-	{
-		return_str[i] = leuart_app_receive_byte(HM10_LEUART0);
-		if (ok_str[i] != return_str[i])
-			EFM_ASSERT(false);
-	}
+/**
+ * @brief
+ * 	ends the AT exchange
+ * @details
+ * 	drops any commands left, restores '<' '>' command reception, posts the done event and
+ * 	lets the queued BLE packets go out
+ * @param[in] result
+ * 	0 if every command was answered, otherwise the number (from 1) of the command that
+ * 	timed out. Posted as the payload of the done event.
+**/
+static void ble_at_finish(uint32_t result)
+{
+	soft_timer_stop(ble_at_timer);
+	remove_scheduled_event(ble_at_timeout_evt);	// the RTCC may already have posted it
+	ble_at_count = 0;
+	ble_at_state = BLE_AT_IDLE;
+	leuart_rx_frame(HM10_LEUART0, HM10_STARTF, HM10_SIGF, true);
+	ring_read(&ble_rx_ring, NULL, BLE_RX_SIZE);
+	leuart_rx_resume();
+	post_scheduled_event(ble_at_done_evt, result);
+	ble_circ_pop(false);
+}
 
-	// This sequence of code will be writing or programming the name of
-	// the module to the DSD HM10
-	str_len = strlen(output_str);
-	for (int i = 0; i < str_len; i++)
-		leuart_app_transmit_byte(HM10_LEUART0, output_str[i]);
+/**
+ * @brief
+ * 	collects the HM-10's response to the pending AT command
+ * @details
+ * 	appends everything received to ble_at_rx. Once it holds the expected response the
+ * 	command is done, and the next one is sent.
+ * @note
+ * 	the response is searched for, not compared, so the HM-10 may add to it (e.g. OK+LOST)
+ * 	and it may arrive split over several frames (SIGF also appearing earlier in it)
+**/
+static void ble_at_receive(void)
+{
+	uint32_t len;
 
-	// Here will be the check on the response back from the DSD HM10 on the
-	// programming of its name
-	str_len = strlen(result_str);
-	for (int i = 0; i < str_len; i++)
+	while ((len = ring_count(&ble_rx_ring)))
 	{
-		return_str[i] = leuart_app_receive_byte(HM10_LEUART0);
-		if (result_str[i] != return_str[i])
-			EFM_ASSERT(false);
+		if (len > sizeof(ble_at_rx) - 1 - ble_at_rxlen)
+		{
+			//keep the newest half, the response is at the end
+			uint32_t keep = (sizeof(ble_at_rx) - 1) / 2;
+			if (ble_at_rxlen > keep)
+			{
+				memmove(ble_at_rx, &ble_at_rx[ble_at_rxlen - keep], keep);
+				ble_at_rxlen = keep;
+			}
+			len = sizeof(ble_at_rx) - 1 - ble_at_rxlen;
+		}
+		ble_at_rxlen += ring_read(&ble_rx_ring, &ble_at_rx[ble_at_rxlen], len);
 	}
+	ble_at_rx[ble_at_rxlen] = '\0';
+	leuart_rx_resume();
 
-	// It is now time to send the command to RESET the DSD HM10 module
-	str_len = strlen(reset_str);
-	for (int i = 0; i < str_len; i++)
-		leuart_app_transmit_byte(HM10_LEUART0, reset_str[i]);
+	if (ble_at_state != BLE_AT_WAIT || !strstr(ble_at_rx, ble_at_queue[ble_at_head].resp))
+		return;
 
-	// After sending the command to RESET, the DSD HM10 will send a response
-	// back to the micro-controller
-	str_len = strlen(reset_result_str);
-	for (int i = 0; i < str_len; i++)
+	soft_timer_stop(ble_at_timer);
+	remove_scheduled_event(ble_at_timeout_evt);	// or it would time out the next command
+	ble_at_head = (ble_at_head + 1) % BLE_AT_QUEUE;
+	ble_at_step++;
+	if (!--ble_at_count)
 	{
-		return_str[i] = leuart_app_receive_byte(HM10_LEUART0);
-		if (reset_result_str[i] != return_str[i])
-			EFM_ASSERT(false);
+		ble_at_finish(0);
+		return;
 	}
+	ble_at_state = BLE_AT_SEND;
+	ble_at_frame(&ble_at_queue[ble_at_head]);
+	ble_at_kick();
+}
 
-	// After the test and programming have been completed, the original
-	// state of the LEUART must be restored
-	if (!rx_en) leuart_cmd_write(HM10_LEUART0, LEUART_CMD_RXDIS);
-	if (rx_disabled) leuart_cmd_write(HM10_LEUART0, LEUART_CMD_RXBLOCKEN);
-	if (!tx_en) leuart_cmd_write(HM10_LEUART0, LEUART_CMD_TXDIS);
-	leuart_if_reset(HM10_LEUART0);
+/**
+ * @brief
+ * 	sets up the AT engine
+ * @param[in] timer
+ * 	soft timer id for the response timeouts
+ * @param[in] timeout_event
+ * 	scheduler event ID the timer posts, its handler must call ble_at_timeout()
+ * @param[in] done_event
+ * 	scheduler event ID posted when an exchange ends, see ble_at_finish() for the payload
+**/
+void ble_at_open(uint32_t timer, uint32_t timeout_event, uint32_t done_event)
+{
+	ble_at_timer = timer;
+	ble_at_timeout_evt = timeout_event;
+	ble_at_done_evt = done_event;
+	ble_at_state = BLE_AT_IDLE;
+	ble_at_head = ble_at_count = 0;
+}
 
-	__enable_irq();
+/**
+ * @brief
+ * 	queues an AT command for the next exchange
+ * @param[in] cmd
+ * 	command sent to the HM-10
+ * @param[in] resp
+ * 	response that completes the command, not empty
+ * @param[in] timeout_ms
+ * 	time the HM-10 has to answer
+ * @returns
+ * 	false if an exchange is running, the queue is full, or a string is too long
+**/
+bool ble_at_push(const char * cmd, const char * resp, uint32_t timeout_ms)
+{
+	if (ble_at_state != BLE_AT_IDLE || ble_at_count >= BLE_AT_QUEUE)
+		return false;
+	if (strlen(cmd) >= BLE_AT_LEN || !*resp || strlen(resp) >= BLE_AT_LEN)
+		return false;
+
+	BLE_AT_STRUCT * at = &ble_at_queue[(ble_at_head + ble_at_count) % BLE_AT_QUEUE];
+	strcpy(at -> cmd, cmd);
+	strcpy(at -> resp, resp);
+	at -> timeout_ms = timeout_ms;
+	ble_at_count++;
+	return true;
+}
+
+/**
+ * @brief
+ * 	starts an exchange of the queued AT commands
+ * @details
+ * 	the commands are sent one at a time, each after the last one was answered. Queued
+ * 	BLE packets are held until the exchange ends, and received '<' '>' commands are lost.
+ * 	Other events keep being serviced, and the core sleeps in between.
+ * @returns
+ * 	false if an exchange is already running or nothing is queued
+**/
+bool ble_at_start(void)
+{
+	if (ble_at_state != BLE_AT_IDLE || !ble_at_count)
+		return false;
 
+	ring_read(&ble_rx_ring, NULL, BLE_RX_SIZE);
+	ble_at_step = 0;
+	ble_at_state = BLE_AT_SEND;
+	ble_at_frame(&ble_at_queue[ble_at_head]);
+	ble_at_kick();
 	return true;
 }
+
+/**
+ * @brief
+ * 	handles the AT response timeout, from the timeout event's handler
+ * @details
+ * 	ends the exchange, reporting the command that was not answered
+**/
+void ble_at_timeout(void)
+{
+	if (ble_at_state == BLE_AT_WAIT)
+		ble_at_finish(ble_at_step + 1);
+}
+
+/**
+ * @brief
+ * 	checks if an AT exchange is running
+**/
+bool ble_at_busy(void)
+{
+	return ble_at_state != BLE_AT_IDLE;
+}
+
+/**
+ * @brief
+ * 	configures the HM-10 with an AT exchange
+ * @details
+ * 	sets the advertised name, the transmit power (HM10_AT_POWER), the advertising
+ * 	interval (HM10_AT_ADVI), the baud rate (HM10_AT_BAUD) and a steady STATE pin
+ * 	(HM10_AT_PIO1), then resets the module so they take effect
+ * @note
+ * 	the HM-10 only takes AT commands while it is not connected, the leading AT drops a
+ * 	connection
+ * @param[in] mod_name
+ * 	name advertised by the HM-10, at most 12 characters
+ * @returns
+ * 	false if the exchange could not be queued, the result comes with the done event
+**/
+bool ble_configure(char * mod_name)
+{
+	char cmd[BLE_AT_LEN];
+	char resp[BLE_AT_LEN];
+	FMT_STRUCT fmt;
+	bool ok;
+
+	if (strlen(mod_name) > 12)
+		return false;
+
+	ok = ble_at_push("AT", "OK", BLE_AT_TIMEOUT_MS);
+	fmt_init(&fmt, cmd, sizeof(cmd));
+	fmt_str(&fmt, "AT+NAME");
+	fmt_str(&fmt, mod_name);
+	fmt_init(&fmt, resp, sizeof(resp));
+	fmt_str(&fmt, "OK+Set:");
+	fmt_str(&fmt, mod_name);
+	ok = ok && ble_at_push(cmd, resp, BLE_AT_TIMEOUT_MS);
+	ok = ok && ble_at_push("AT+POWE" HM10_AT_POWER, "OK+Set:" HM10_AT_POWER, BLE_AT_TIMEOUT_MS);
+	ok = ok && ble_at_push("AT+ADVI" HM10_AT_ADVI, "OK+Set:" HM10_AT_ADVI, BLE_AT_TIMEOUT_MS);
+	ok = ok && ble_at_push("AT+BAUD" HM10_AT_BAUD, "OK+Set:" HM10_AT_BAUD, BLE_AT_TIMEOUT_MS);
+	ok = ok && ble_at_push("AT+PIO1" HM10_AT_PIO1, "OK+Set:" HM10_AT_PIO1, BLE_AT_TIMEOUT_MS);
+	ok = ok && ble_at_push("AT+RESET", "OK+RESET", BLE_AT_RESET_MS);
+	if (!ok)
+	{
+		ble_at_count = 0;
+		return false;
+	}
+	return ble_at_start();
+}
+
 /**
  * @brief
  * 	initializes the private circular buffer for ble.c
  * @details
- * 	sets the read and write pointers to 0, sets the size, creates the mask
+ * 	empties the body and length rings over their storage in ble_cbuf
 **/
 void ble_circ_init(void)
 {
-	ble_cbuf.read_ptr = ble_cbuf.write_ptr = 0;
-	ble_cbuf.size = CSIZE; //MUST BE POWER OF 2
-	ble_cbuf.size_mask = CSIZE - 1;
+	ring_init(&ble_cbuf.body, ble_cbuf.cbuf, CSIZE);
+	ring_init(&ble_cbuf.lens, ble_cbuf.len_buf, BLE_PACKETS * 2);
+	ble_tx_inflight = ble_tx_inflight_packets = 0;
 }
 /**
  * @brief
  *	pushes a string onto the circular buffer
  * @details
- * 	checks if there is room for the packet, then copies the data into the circular buffer
+ * 	checks if there is room for the packet, making room as the overflow policy allows
+ * 	(only if the packet then fits, see ble_circ_plan()), then writes the body to the body ring and its length entry to the length ring
+ * @note
+ * 	packets are only limited by the size of the circular buffer, they are transmitted
+ * 	straight out of it. Packets in flight are never dropped. An empty string has nothing
+ * 	to send and is not queued, LEUART cannot start an empty transfer.
  * @param[in] string
  * 	the string to be pushed onto the buffer
+ * @param[in] telemetry
+ * 	marks the packet as telemetry, see BLE_OVERWRITE_TELEMETRY
+ * @returns
+ * 	whether the string was queued, see ble_write_t
 **/
-void ble_circ_push(char * string)
+ble_write_t ble_circ_push(char * string, bool telemetry)
 {
-	EFM_ASSERT(ble_circ_space());
+	ble_write_t result = BLE_WRITE_OK;
+	uint32_t len = strlen(string);
 
-	uint8_t len = strlen(string);
+	if (!len)
+		return BLE_WRITE_OK;
+	if (len > CSIZE || len > BLE_LEN_MASK)
+	{
+		ble_drop_count++;
+		return BLE_WRITE_TOO_LONG;
+	}
 	//ROOM FOR PACKET?
-	if ((len + 1) <= ble_circ_space())
+	if (!ble_circ_fits(len))
 	{
-		//PACKET HEADER
-		ble_cbuf.cbuf[ble_cbuf.write_ptr] = (char) len;
-		update_circ_wrtindex(&ble_cbuf, 1);
-		//PACKET BODY
-		for (int i = 0; i < len; i++)
+		uint32_t first;
+		int32_t drops = ble_circ_plan(len, telemetry, &first);
+
+		if (drops < 0)
 		{
-			ble_cbuf.cbuf[ble_cbuf.write_ptr] = string[i];
-			update_circ_wrtindex(&ble_cbuf, 1);
+			ble_drop_count++;
+			return BLE_WRITE_DROPPED;
 		}
+		while (drops--)
+			ble_circ_remove(first);
+		result = BLE_WRITE_DISPLACED;
 	}
-	else
-	{
-		EFM_ASSERT(false);
-	}
+	//PACKET BODY
+	ring_write(&ble_cbuf.body, string, len);
+	//PACKET HEADER
+	uint32_t entry = len | (telemetry ? BLE_LEN_TELEMETRY : 0);
+	uint8_t header[2] = { entry & 0xFF, entry >> 8 };
+	ring_write(&ble_cbuf.lens, header, sizeof(header));
+	return result;
+}
+/**
+ * @brief
+ * 	TDD routine for BLE_OVERWRITE_TELEMETRY
+ * @details
+ * 	a reading replaces the newest telemetry packet even behind a newer reply, and a
+ * 	reading that would not fit even then is rejected without dropping anything
+**/
+static void ble_circ_policy_test(void)
+{
+	char tele[32];
+	char reply[CSIZE];
+	uint32_t drops = ble_drop_count;
+
+	ble_circ_init();
+	ble_overflow_policy(BLE_OVERWRITE_TELEMETRY);
+	memset(reply, 'r', sizeof(reply));
+
+	// TEST 1: [telemetry 10, reply 100] + telemetry 20 -> [reply 100, telemetry 20]
+	memset(tele, 'a', 10);
+	tele[10] = '\0';
+	reply[100] = '\0';
+	EFM_ASSERT(ble_circ_push(tele, true) == BLE_WRITE_OK);
+	EFM_ASSERT(ble_circ_push(reply, false) == BLE_WRITE_OK);
+	memset(tele, 'b', 20);
+	tele[20] = '\0';
+	EFM_ASSERT(ble_circ_push(tele, true) == BLE_WRITE_DISPLACED);
+	EFM_ASSERT(ble_circ_count() == 2 && ble_circ_len(0) == 100 && ble_circ_len(1) == 20);
+	EFM_ASSERT(ble_drop_count == drops + 1);
+
+	// TEST 2: [telemetry 10, reply 110] + telemetry 30 does not fit, nothing is dropped
+	ble_circ_init();
+	memset(tele, 'a', 10);
+	tele[10] = '\0';
+	reply[100] = 'r';
+	reply[110] = '\0';
+	ble_circ_push(tele, true);
+	ble_circ_push(reply, false);
+	memset(tele, 'c', 30);
+	tele[30] = '\0';
+	EFM_ASSERT(ble_circ_push(tele, true) == BLE_WRITE_DROPPED);
+	EFM_ASSERT(ble_circ_count() == 2 && ble_circ_len(0) == 10 && ble_circ_len(1) == 110);
+	EFM_ASSERT(ble_drop_count == drops + 2);
+
+	ble_circ_init();
+	ble_overflow_policy(BLE_OVERFLOW_POLICY);
+	ble_drop_count = drops;
 }
 /**
  * @brief
@@ -340,8 +750,7 @@ void circular_buff_test(void)
 	 // Why this 0 initialize of read and write pointer?
 	 // Student Response: because we want the buffer to be empty (ridx = widx)
 	 //
-	 ble_cbuf.read_ptr = 0;
-	 ble_cbuf.write_ptr = 0;
+	 ble_circ_init();
 
 	 // Why do none of these test strings contain a 0?
 	 // Student Response: two reasons: 1) none of the for loops allow 0 to be a value (+1, +20, +35) but the real reason is 2) the ASCII character 00000000 is a NULL character and we never want to see this
@@ -358,7 +767,7 @@ void circular_buff_test(void)
 
 	 // Why is there only one push to the circular buffer at this stage of the test
 	 // Student Response: because we're just testing one string
-	 ble_circ_push(&test_struct.test_str[0][0]);
+	 ble_circ_push(&test_struct.test_str[0][0], false);
 
 	 // Why is the expected buff_empty test = false?
 	 // Student Response: because we are popping off a string and the buffer is NOT empty, we should expect a value of false
@@ -372,11 +781,11 @@ void circular_buff_test(void)
 	 // What does this next push on the circular buffer test?
 	 // Student Response: we're testing the second string (with a different length)
 
-	 ble_circ_push(&test_struct.test_str[1][0]);
+	 ble_circ_push(&test_struct.test_str[1][0], false);
 
 	 // What does this next push on the circular buffer test?
 	 // Student Response: we're testing the third string (with yet another different length)
-	 ble_circ_push(&test_struct.test_str[2][0]);
+	 ble_circ_push(&test_struct.test_str[2][0], false);
 
 
 	 // Why is the expected buff_empty test = false?
@@ -403,52 +812,91 @@ void circular_buff_test(void)
 	 // Student Response: because the circular buffer is empty at this point, it will not be able to pop
 	 buff_empty = ble_circ_pop(CIRC_TEST);
 	 EFM_ASSERT(buff_empty == true);
+	 ble_circ_policy_test();
 	 ble_write("\nPassed Circular Buffer Test\n");
 }
 /**
  * @brief
- *	pops a string off of the circular buffer, either to the test_struct or to LEUART (via ble_tx_string)
+ *	pops strings off of the circular buffer, either to the test_struct or to LEUART
  * @details
- *	checks if the buffer is empty, attempts to pop (depending on the size of the packet and if there is room)
+ *	checks if the buffer is empty, then either copies one packet out (TDD) or transmits
+ *	straight out of ble_cbuf. For LEUART, as many whole queued packets as fit in
+ *	BLE_TX_FRAME_BUDGET bytes are sent as one transfer (a longer packet goes alone). The
+ *	bodies are back to back in cbuf, so a transfer that wraps the end of cbuf is sent as
+ *	two segments.
+ * @note
+ *	the read indeces only move past a transfer once LEUART is done with it: the next call
+ *	with LEUART idle (normally from the TX done event) commits it, so ble_circ_push() can
+ *	never overwrite bytes still being sent. While an AT exchange runs nothing is sent, the
+ *	transmitter is left to the AT engine, and while no phone is connected the queue is
+ *	held until ble_link() reports a connection.
  * @param[in] test
  *	boolean indicating if we are calling a test pop (for TDD) or not
+ * @returns
+ *	true if there was nothing to pop
 **/
 bool ble_circ_pop(bool test)
 {
+	if (!test && ble_tx_inflight_packets && !leuart_tx_busy(HM10_LEUART0))
+	{
+		ring_read_commit(&ble_cbuf.body, ble_tx_inflight);
+		ring_read_commit(&ble_cbuf.lens, 2 * ble_tx_inflight_packets);
+		ble_tx_inflight = ble_tx_inflight_packets = 0;
+	}
+	if (!test && ble_at_state != BLE_AT_IDLE)
+	{
+		ble_at_kick();
+		return ble_circ_isEmpty();
+	}
+
 	if (!ble_circ_isEmpty())
 	{
 		if (test)
 		{
-			uint8_t len = (uint8_t)ble_cbuf.cbuf[ble_cbuf.read_ptr];
-			update_circ_readindex(&ble_cbuf, 1);
-			for (int i = 0; i < len; i++)
-			{
-				test_struct.result_str[i] = ble_cbuf.cbuf[ble_cbuf.read_ptr];
-				update_circ_readindex(&ble_cbuf, 1);
-			}
+			uint32_t len = ble_circ_len(0);
+			ring_read(&ble_cbuf.lens, NULL, 2);
+			ring_read(&ble_cbuf.body, test_struct.result_str, len);
 			return false;
 		}
-		else if (!leuart_tx_busy(HM10_LEUART0))
+		else if (!ble_tx_inflight_packets && ble_link_up)
 		{
-			uint8_t len = (uint8_t)ble_cbuf.cbuf[ble_cbuf.read_ptr];
-			if (len + 1 <= BLE_STR_SIZE)
+			uint32_t count = ble_circ_count();
+			uint32_t len = 0, packets = 0;
+			do
 			{
-				update_circ_readindex(&ble_cbuf, 1);
-				for (int i = 0; i < len; i++)
-				{
-					ble_tx_string[i] = ble_cbuf.cbuf[ble_cbuf.read_ptr];
-					update_circ_readindex(&ble_cbuf, 1);
-				}
-				ble_tx_string[len] = '\0';
-				leuart_start(HM10_LEUART0, ble_tx_string, len);
-				return false;
+				len += ble_circ_len(packets);
+				packets++;
+			} while (packets != count && len + ble_circ_len(packets) <= BLE_TX_FRAME_BUDGET);
+
+			uint8_t * body0 = ble_cbuf.cbuf;
+			uint8_t * body1 = ble_cbuf.cbuf;
+			uint32_t len0 = ring_read_span(&ble_cbuf.body, 0, &body0);
+			if (len0 > len)
+				len0 = len;
+			if (len0 < len)
+				ring_read_span(&ble_cbuf.body, len0, &body1);
+
+			if (leuart_start_segments(HM10_LEUART0, (char *)body0, len0, (char *)body1, len - len0))
+			{
+				ble_tx_inflight = len;
+				ble_tx_inflight_packets = packets;
 			}
-			else
-				EFM_ASSERT(false);
+			return false;
 		}
 	}
 	return true;
 }
+/**
+ * @brief
+ *  pops the next command for ble_rx_test()
+ * @returns
+ *  the command, or an empty string if none was received
+**/
+static char * ble_rx_test_cmd(void)
+{
+	char * cmd = ble_getCMD();
+	return cmd ? cmd : "";
+}
 /**
  * @brief
  *  TDD routine for BLE RX
@@ -467,6 +915,24 @@ void ble_rx_test()
 	ifn (HM10_LEUART0 -> STATUS & LEUART_STATUS_RXENS)
 		EFM_ASSERT(false);
 
+#if LEUART_RX_DMA
+	// TEST  2:
+	//	verify that interrupt is NOT enabled for STARTF (LDMA receives the frame)
+	if (HM10_LEUART0 -> IEN & LEUART_IEN_STARTF)
+		EFM_ASSERT(false);
+
+	// TEST  3:
+	//	verify that interrupt is enabled for SIGF, the only RX wake-up
+	ifn (HM10_LEUART0 -> IEN & LEUART_IEN_SIGF)
+		EFM_ASSERT(false);
+
+	// TEST  4:
+	//	verify that interrupt is NOT enabled for RXDATAV, and that LDMA can run in EM2
+	if (HM10_LEUART0 -> IEN & LEUART_IEN_RXDATAV)
+		EFM_ASSERT(false);
+	ifn (HM10_LEUART0 -> CTRL & LEUART_CTRL_RXDMAWU)
+		EFM_ASSERT(false);
+#else
 	// TEST  2:
 	//	verify that interrupt is enabled for STARTF
 	ifn (HM10_LEUART0 -> IEN & LEUART_IEN_STARTF)
@@ -481,6 +947,7 @@ void ble_rx_test()
 	//	verify that interrupt is enabled for RXDATAV
 	ifn (HM10_LEUART0 -> IEN & LEUART_IEN_RXDATAV)
 		EFM_ASSERT(false);
+#endif
 
 	// TEST  5:
 	//	verify that RXBLOCK is enabled
@@ -507,57 +974,75 @@ void ble_rx_test()
 	ble_rx_done_evt = (ble_tx_done_evt = 0);
 
 	HM10_LEUART0 -> IFC = HM10_LEUART0 -> IF;
+	ring_read(&ble_rx_ring, NULL, BLE_RX_SIZE);
 	__enable_irq();
 	char testString[32];
 
 	// TEST  8
 	//	test character writes (blocked)
-	sprintf(testString, "abcde");
+	strcpy(testString, "abcde");
 	leuart_start(HM10_LEUART0, testString, strlen(testString));
 	while(leuart_tx_busy(HM10_LEUART0) || leuart_rx_busy());
-	if (strcmp("", ble_rx_string))
+	if (strcmp("", ble_rx_test_cmd()))
 		EFM_ASSERT(false);
 
 	// TEST  9
 	//	test character writes with sigf (blocked)
-	sprintf(testString, "abcde>");
+	strcpy(testString, "abcde>");
 	leuart_start(HM10_LEUART0, testString, strlen(testString));
 	while(leuart_tx_busy(HM10_LEUART0) || leuart_rx_busy());
-	if (strcmp("", ble_rx_string))
+	if (strcmp("", ble_rx_test_cmd()))
 		EFM_ASSERT(false);
 
 	// TEST 10:
 	//	test empty command (start, sig)
-	sprintf(testString, "<>");
+	strcpy(testString, "<>");
 	leuart_start(HM10_LEUART0, testString, strlen(testString));
 	while(leuart_tx_busy(HM10_LEUART0) || leuart_rx_busy());
-	if (strcmp(testString, ble_rx_string))
+	if (strcmp(testString, ble_rx_test_cmd()))
 		EFM_ASSERT(false);
 
 	// TEST 11:
 	//	test command that fits in rxstring
-	sprintf(testString, "<tempQ>");
+	strcpy(testString, "<tempQ>");
 	leuart_start(HM10_LEUART0, testString, strlen(testString));
 	while(leuart_tx_busy(HM10_LEUART0) || leuart_rx_busy());
-	if (strcmp(testString, ble_rx_string))
+	if (strcmp(testString, ble_rx_test_cmd()))
 		EFM_ASSERT(false);
 
 	// TEST 12:
 	//	test repeated start, full overwrite
-	sprintf(testString, "<tempR<tempQ>");
+	strcpy(testString, "<tempR<tempQ>");
 	leuart_start(HM10_LEUART0, testString, strlen(testString));
-	sprintf(testString, "<tempQ>");
+	strcpy(testString, "<tempQ>");
 	while(leuart_tx_busy(HM10_LEUART0) || leuart_rx_busy());
-	if (strcmp(testString, ble_rx_string))
+	if (strcmp(testString, ble_rx_test_cmd()))
 		EFM_ASSERT(false);
 
 	// TEST 13:
 	//	test repeated start, only partial overwrite
-	sprintf(testString, "<tempS<tempR<tempQ>");
+	strcpy(testString, "<tempS<tempR<tempQ>");
 	leuart_start(HM10_LEUART0, testString, strlen(testString));
-	sprintf(testString, "<tempQ>");
+	strcpy(testString, "<tempQ>");
 	while(leuart_tx_busy(HM10_LEUART0) || leuart_rx_busy());
-	if (strcmp(testString, ble_rx_string))
+	if (strcmp(testString, ble_rx_test_cmd()))
+		EFM_ASSERT(false);
+
+	// TEST 14:
+	//	test back to back commands, both are queued in order
+	strcpy(testString, "<tempQ><tempR>");
+	leuart_start(HM10_LEUART0, testString, strlen(testString));
+	while(leuart_tx_busy(HM10_LEUART0) || leuart_rx_busy());
+	if (strcmp("<tempQ>", ble_rx_test_cmd()) || strcmp("<tempR>", ble_rx_test_cmd()))
+		EFM_ASSERT(false);
+
+	// TEST 15:
+	//	test command too long for ble_rx_string, rejected whole
+	uint32_t rejects = ble_rx_rejects();
+	strcpy(testString, "<tempQtempQtempQ><tempR>");
+	leuart_start(HM10_LEUART0, testString, strlen(testString));
+	while(leuart_tx_busy(HM10_LEUART0) || leuart_rx_busy());
+	if (strcmp("<tempR>", ble_rx_test_cmd()) || ble_rx_rejects() != rejects + 1)
 		EFM_ASSERT(false);
 
 //POST (RESTORE)
@@ -572,13 +1057,55 @@ void ble_rx_test()
 }
 /**
  * @brief
- * 	generic getter for ble_rx_string
+ * 	pops the next received command off ble_rx_ring
  * @details
- *	to be used by app.c in the scheduled_leuart_rx event
+ *	copies one frame, up to and including HM10_SIGF, into ble_rx_string. To be used by
+ *	app.c in the scheduled_leuart_rx_done_evt, until it returns NULL, so every command
+ *	queued since the last event is handled in order.
+ * @note
+ *	a frame that does not fit in ble_rx_string is discarded whole and counted, see
+ *	ble_rx_rejects(). A repeated HM10_STARTF restarts the command, LDMA does not see
+ *	start frames. During an AT exchange everything received goes to the AT engine.
  * @return
- * 	ble_rx_string (char *)
+ * 	ble_rx_string (char *), or NULL if no command is queued
 **/
 char * ble_getCMD()
 {
-	return ble_rx_string;
+	uint32_t len;
+	bool too_long;
+	uint8_t c;
+
+	if (ble_at_state != BLE_AT_IDLE)
+	{
+		ble_at_receive();
+		return NULL;
+	}
+	while (ring_count(&ble_rx_ring))
+	{
+		len = 0;
+		too_long = false;
+		do
+		{
+			if (!ring_read(&ble_rx_ring, &c, 1))
+				break;
+			if (c == HM10_STARTF)
+			{
+				len = 0;
+				too_long = false;
+			}
+			if (len < sizeof(ble_rx_string) - 1)
+				ble_rx_string[len++] = c;
+			else
+				too_long = true;
+		} while (c != HM10_SIGF);
+		leuart_rx_resume();
+
+		if (!too_long)
+		{
+			ble_rx_string[len] = '\0';
+			return ble_rx_string;
+		}
+		ble_rx_reject_count++;
+	}
+	return NULL;
 }
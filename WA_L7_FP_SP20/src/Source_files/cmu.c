@@ -28,6 +28,7 @@ void cmu_open(void)
 	CMU_ClockSelectSet(cmuClock_LFB, cmuSelect_LFXO);	// route LFXO to LEUART0
 
 	CMU_ClockSelectSet(cmuClock_LFA, cmuSelect_ULFRCO);	// route ULFRCO to proper Low Freq clock tree
+	CMU_ClockSelectSet(cmuClock_LFE, cmuSelect_ULFRCO);	// route ULFRCO to the RTCC (soft timers)
 	// Enabling the High Frequency Peripheral Clock Tree
 	//HFLE is CORELE
 	CMU_ClockEnable(cmuClock_HFLE, true); // Enable the High Frequency Peripheral clock
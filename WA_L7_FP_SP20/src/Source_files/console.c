@@ -0,0 +1,282 @@
+/**
+ * @file console.c
+ * @author William Abrams
+ * @date October 16th, 2026
+ * @brief Table driven command console, parses <name> and <name=arg> frames
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Silicon Lab include files
+#include "em_assert.h"
+
+//** User/developer include files
+#include "console.h"
+#include <string.h>
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+static CONSOLE_COMMAND_STRUCT console_table[CONSOLE_COMMANDS];	/**< registered commands, sorted by name **/
+static uint32_t console_count;									/**< number of registered commands **/
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/**
+ * @brief
+ *	Finds a command in the table
+ * @details
+ *	Binary search, console_table is kept sorted by console_register()
+ * @param[in] name
+ *	command name
+ * @param[out] index
+ *	where the command is, or where it would be inserted
+ * @returns
+ *	true if the command is registered
+ **/
+static bool console_find(const char * name, uint32_t * index)
+{
+	uint32_t low = 0, high = console_count;
+
+	while (low < high)
+	{
+		uint32_t mid = (low + high) / 2;
+		int cmp = strcmp(name, console_table[mid].name);
+		if (!cmp)
+		{
+			*index = mid;
+			return true;
+		}
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	*index = low;
+	return false;
+}
+
+/**
+ * @brief
+ *	Parses an unsigned decimal argument
+ * @param[in] s
+ *	argument string, digits only
+ * @param[out] value
+ *	parsed value
+ * @returns
+ *	false if s is empty, has anything but digits or overflows 32 bits
+ **/
+static bool console_parse_uint(const char * s, uint32_t * value)
+{
+	uint32_t v = 0;
+
+	if (!*s)
+		return false;
+	for (; *s; s++)
+	{
+		uint32_t d = *s - '0';
+		if (d > 9 || v > (UINT32_MAX - d) / 10)
+			return false;
+		v = v * 10 + d;
+	}
+	*value = v;
+	return true;
+}
+
+/**
+ * @brief
+ *	Parses a signed decimal argument into hundredths
+ * @param[in] s
+ *	argument string, an optional '-', digits, and an optional '.' with up to two digits
+ * @param[out] value
+ *	parsed value * CONSOLE_CENTI
+ * @returns
+ *	false if s does not match, or overflows 32 bits
+ **/
+static bool console_parse_centi(const char * s, int32_t * value)
+{
+	bool negative = (*s == '-');
+	uint32_t v = 0, digits = 0;
+	int32_t frac = -1;
+
+	if (negative)
+		s++;
+	for (; *s; s++)
+	{
+		if (*s == '.' && frac < 0)
+		{
+			frac = 0;
+			continue;
+		}
+		uint32_t d = *s - '0';
+		if (d > 9 || frac == 2 || v > (INT32_MAX - d) / 10)
+			return false;
+		v = v * 10 + d;
+		digits++;
+		if (frac >= 0)
+			frac++;
+	}
+	if (!digits)
+		return false;
+	for (frac = (frac < 0) ? 0 : frac; frac < 2; frac++)
+	{
+		if (v > INT32_MAX / 10)
+			return false;
+		v *= 10;
+	}
+	*value = negative ? -(int32_t)v : (int32_t)v;
+	return true;
+}
+
+/**
+ * @brief
+ *	Parses an argument against a command's schema
+ * @param[in] arg
+ *	argument schema
+ * @param[in] s
+ *	argument string, NULL if the frame had no CONSOLE_ARGSEP
+ * @param[out] value
+ *	parsed argument
+ * @returns
+ *	false if the argument does not fit the schema
+ **/
+static bool console_parse(console_arg_t arg, const char * s, console_value_t * value)
+{
+	switch (arg)
+	{
+		case CONSOLE_ARG_NONE:
+			value -> uint = 0;
+			return !s;
+		case CONSOLE_ARG_UINT:
+			return s && console_parse_uint(s, &value -> uint);
+		case CONSOLE_ARG_CENTI:
+			return s && console_parse_centi(s, &value -> centi);
+		case CONSOLE_ARG_CHAR:
+			if (!s || !s[0] || s[1])
+				return false;
+			value -> chr = s[0];
+			return true;
+		default:
+			EFM_ASSERT(false);
+			return false;
+	}
+}
+
+/**
+ * @brief
+ *	Opens the console, with an empty command table
+ * @note
+ *	Must be called before any module registers its commands
+ **/
+void console_open(void)
+{
+	console_count = 0;
+}
+
+/**
+ * @brief
+ *	Registers a console command
+ * @details
+ *	Inserts the command into console_table in name order, so console_dispatch() can
+ *	binary search it. Each driver or app module registers its own commands.
+ * @param[in] name
+ *	command name, without the frame characters, must stay valid
+ * @param[in] arg
+ *	argument schema
+ * @param[in] handler
+ *	called with the parsed argument
+ **/
+void console_register(const char * name, console_arg_t arg, console_handler_t handler)
+{
+	uint32_t index;
+
+	EFM_ASSERT(console_count < CONSOLE_COMMANDS && handler);
+	EFM_ASSERT(!console_find(name, &index));
+
+	memmove(&console_table[index + 1], &console_table[index], (console_count - index) * sizeof(console_table[0]));
+	console_table[index].name = name;
+	console_table[index].arg = arg;
+	console_table[index].handler = handler;
+	console_count++;
+}
+
+/**
+ * @brief
+ *	Parses a command frame and runs its handler
+ * @details
+ *	The frame is split in place: the CONSOLE_SIGF and CONSOLE_ARGSEP characters are
+ *	overwritten with terminators, so nothing is copied
+ * @param[in] frame
+ *	<name> or <name=arg>, modified
+ * @returns
+ *	what happened to the command, see console_result_t
+ **/
+console_result_t console_dispatch(char * frame)
+{
+	size_t len = strlen(frame);
+	uint32_t index;
+	console_value_t value;
+
+	if (len < 3 || frame[0] != CONSOLE_STARTF || frame[len - 1] != CONSOLE_SIGF)
+		return CONSOLE_BAD_FRAME;
+	frame[len - 1] = '\0';
+
+	char * name = frame + 1;
+	char * arg = strchr(name, CONSOLE_ARGSEP);
+	if (arg)
+		*arg++ = '\0';
+
+	if (!console_find(name, &index))
+		return CONSOLE_UNKNOWN;
+	if (!console_parse(console_table[index].arg, arg, &value))
+		return CONSOLE_BAD_ARG;
+	return console_table[index].handler(value) ? CONSOLE_OK : CONSOLE_BAD_ARG;
+}
+
+/**
+ * @brief
+ *	TDD routine for the console parser
+ * @details
+ *	Checks the argument parsers, and that bad frames and unknown commands are refused
+ * @note
+ *	this function contains EFM_ASSERT(false) statements, it is possible to be stuck here
+ **/
+void console_test(void)
+{
+	console_value_t value;
+	char frame[16];
+
+	// TEST 1: unsigned arguments
+	EFM_ASSERT(console_parse(CONSOLE_ARG_UINT, "500", &value) && value.uint == 500);
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_UINT, "", &value));
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_UINT, "5a", &value));
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_UINT, "4294967296", &value));
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_UINT, NULL, &value));
+
+	// TEST 2: decimal arguments, in hundredths
+	EFM_ASSERT(console_parse(CONSOLE_ARG_CENTI, "80.5", &value) && value.centi == 8050);
+	EFM_ASSERT(console_parse(CONSOLE_ARG_CENTI, "-3.25", &value) && value.centi == -325);
+	EFM_ASSERT(console_parse(CONSOLE_ARG_CENTI, "7", &value) && value.centi == 700);
+	EFM_ASSERT(console_parse(CONSOLE_ARG_CENTI, ".5", &value) && value.centi == 50);
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_CENTI, "1.234", &value));
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_CENTI, "1.2.3", &value));
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_CENTI, "-.", &value));
+
+	// TEST 3: character and argument-less schemas
+	EFM_ASSERT(console_parse(CONSOLE_ARG_CHAR, "K", &value) && value.chr == 'K');
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_CHAR, "KF", &value));
+	EFM_ASSERT(console_parse(CONSOLE_ARG_NONE, NULL, &value));
+	EFM_ASSERT(!console_parse(CONSOLE_ARG_NONE, "1", &value));
+
+	// TEST 4: frames
+	strcpy(frame, "<>");
+	EFM_ASSERT(console_dispatch(frame) == CONSOLE_BAD_FRAME);
+	strcpy(frame, "<stats");
+	EFM_ASSERT(console_dispatch(frame) == CONSOLE_BAD_FRAME);
+	strcpy(frame, "<no such=1>");
+	EFM_ASSERT(console_dispatch(frame) == CONSOLE_UNKNOWN);
+}
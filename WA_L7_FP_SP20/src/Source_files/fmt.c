@@ -0,0 +1,236 @@
+/**
+ * @file fmt.c
+ * @author William Abrams
+ * @date October 16th, 2026
+ * @brief Integer and fixed-point decimal formatting, without newlib's printf
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Silicon Lab include files
+#include "em_device.h"
+#include "em_assert.h"
+
+//** User/developer include files
+#include "fmt.h"
+#include <string.h>
+#ifdef FMT_BENCH_SNPRINTF
+#include <stdio.h>
+#endif
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/**
+ * @brief
+ *	Starts formatting a line into buf
+ * @param[in] fmt
+ *	line to start
+ * @param[out] buf
+ *	output, left as an empty string
+ * @param[in] size
+ *	size of buf, at least 1
+ **/
+void fmt_init(FMT_STRUCT * fmt, char * buf, size_t size)
+{
+	EFM_ASSERT(size);
+	fmt -> buf = buf;
+	fmt -> size = size;
+	fmt -> len = 0;
+	buf[0] = '\0';
+}
+
+/**
+ * @brief
+ *	Appends a character
+ * @param[in] fmt
+ *	line being formatted
+ * @param[in] c
+ *	character to append
+ **/
+void fmt_char(FMT_STRUCT * fmt, char c)
+{
+	if (fmt -> len + 1 < fmt -> size)
+	{
+		fmt -> buf[fmt -> len++] = c;
+		fmt -> buf[fmt -> len] = '\0';
+	}
+}
+
+/**
+ * @brief
+ *	Appends a string
+ * @param[in] fmt
+ *	line being formatted
+ * @param[in] s
+ *	string to append
+ **/
+void fmt_str(FMT_STRUCT * fmt, const char * s)
+{
+	while (*s && fmt -> len + 1 < fmt -> size)
+		fmt -> buf[fmt -> len++] = *s++;
+	fmt -> buf[fmt -> len] = '\0';
+}
+
+/**
+ * @brief
+ *	Appends the decimal digits of value, at least min_digits of them
+ * @details
+ *	Digits are produced lowest first into a scratch buffer, one divide by a constant
+ *	(a multiply on the M4) per digit
+ **/
+static void fmt_digits(FMT_STRUCT * fmt, uint32_t value, uint32_t min_digits)
+{
+	char digits[10];
+	uint32_t n = 0;
+
+	do
+	{
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value || n < min_digits);
+
+	while (n)
+		fmt_char(fmt, digits[--n]);
+}
+
+/**
+ * @brief
+ *	Appends an unsigned decimal
+ * @param[in] fmt
+ *	line being formatted
+ * @param[in] value
+ *	value to append
+ **/
+void fmt_uint(FMT_STRUCT * fmt, uint32_t value)
+{
+	fmt_digits(fmt, value, 1);
+}
+
+/**
+ * @brief
+ *	Appends a signed decimal
+ * @param[in] fmt
+ *	line being formatted
+ * @param[in] value
+ *	value to append
+ **/
+void fmt_int(FMT_STRUCT * fmt, int32_t value)
+{
+	fmt_fixed(fmt, value, 0);
+}
+
+/**
+ * @brief
+ *	Appends a fixed-point decimal
+ * @details
+ *	value is in 1 / 10^frac_digits units, so fmt_fixed(fmt, -325, 2) appends "-3.25" and
+ *	fmt_fixed(fmt, -5, 2) appends "-0.05". Exactly frac_digits digits follow the point.
+ * @param[in] fmt
+ *	line being formatted
+ * @param[in] value
+ *	scaled value to append
+ * @param[in] frac_digits
+ *	digits after the decimal point, 0 to 9
+ **/
+void fmt_fixed(FMT_STRUCT * fmt, int32_t value, uint32_t frac_digits)
+{
+	static const uint32_t scale[10] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+	uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+
+	EFM_ASSERT(frac_digits < 10);
+	if (value < 0)
+		fmt_char(fmt, '-');
+	fmt_digits(fmt, magnitude / scale[frac_digits], 1);
+	if (frac_digits)
+	{
+		fmt_char(fmt, '.');
+		fmt_digits(fmt, magnitude % scale[frac_digits], frac_digits);
+	}
+}
+
+/**
+ * @brief
+ *	Formats the benchmark line for value, as a telemetry reading in hundredths
+ **/
+static void fmt_bench_line(FMT_STRUCT * fmt, char * line, size_t size, int32_t value)
+{
+	fmt_init(fmt, line, size);
+	fmt_fixed(fmt, value, 2);
+	fmt_str(fmt, " C\n");
+}
+
+/**
+ * @brief
+ *	TDD routine and benchmark for the formatter
+ * @details
+ *	Checks signs, leading fractional zeros, the 32 bit limits and truncation, then times
+ *	FMT_BENCH_LINES telemetry lines
+ * @note
+ *	this function contains EFM_ASSERT(false) statements, it is possible to be stuck here.
+ *	Needs the DWT cycle counter, call it after scheduler_open().
+ * @returns
+ *	DWT cycles taken by the benchmark, compare with fmt_bench_snprintf()
+ **/
+uint32_t fmt_test(void)
+{
+	FMT_STRUCT fmt;
+	char line[16];
+
+	// TEST 1: fixed point, sign and leading fractional zeros
+	fmt_bench_line(&fmt, line, sizeof(line), 2350);
+	EFM_ASSERT(!strcmp(line, "23.50 C\n") && fmt.len == 8);
+	fmt_bench_line(&fmt, line, sizeof(line), -325);
+	EFM_ASSERT(!strcmp(line, "-3.25 C\n"));
+	fmt_bench_line(&fmt, line, sizeof(line), -5);
+	EFM_ASSERT(!strcmp(line, "-0.05 C\n"));
+	fmt_init(&fmt, line, sizeof(line));
+	fmt_fixed(&fmt, 2305, 1);
+	EFM_ASSERT(!strcmp(line, "230.5"));
+
+	// TEST 2: integers, and the 32 bit limits
+	fmt_init(&fmt, line, sizeof(line));
+	fmt_uint(&fmt, 0);
+	fmt_char(&fmt, ' ');
+	fmt_uint(&fmt, UINT32_MAX);
+	EFM_ASSERT(!strcmp(line, "0 4294967295"));
+	fmt_init(&fmt, line, sizeof(line));
+	fmt_int(&fmt, INT32_MIN);
+	EFM_ASSERT(!strcmp(line, "-2147483648"));
+
+	// TEST 3: output is cut off, and stays terminated
+	fmt_init(&fmt, line, 6);
+	fmt_str(&fmt, "EM");
+	fmt_uint(&fmt, 12345);
+	EFM_ASSERT(!strcmp(line, "EM123") && fmt.len == 5);
+
+	// BENCHMARK
+	uint32_t start = DWT -> CYCCNT;
+	for (int i = 0; i < FMT_BENCH_LINES; i++)
+		fmt_bench_line(&fmt, line, sizeof(line), 2000 + 37 * i);
+	return DWT -> CYCCNT - start;
+}
+
+#ifdef FMT_BENCH_SNPRINTF
+/**
+ * @brief
+ *	Times the fmt_test() benchmark lines formatted with snprintf
+ * @returns
+ *	DWT cycles taken
+ **/
+uint32_t fmt_bench_snprintf(void)
+{
+	char line[16];
+
+	uint32_t start = DWT -> CYCCNT;
+	for (int i = 0; i < FMT_BENCH_LINES; i++)
+	{
+		int32_t value = 2000 + 37 * i;
+		snprintf(line, sizeof(line), "%ld.%02ld C\n", (long)(value / 100), (long)(value % 100));
+	}
+	return DWT -> CYCCNT - start;
+}
+#endif
@@ -10,8 +10,15 @@
 //***********************************************************************************
 #include "gpio.h"
 #include "em_cmu.h"
+#include "em_assert.h"
+#include "scheduler.h"
 #include <stdbool.h>
 
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+static uint32_t gpio_int_evt[GPIO_EXT_INTS];	/**< scheduler event ID posted by each external interrupt **/
+
 //***********************************************************************************
 // functions
 //***********************************************************************************
@@ -44,5 +51,67 @@ void gpio_open(void)
 	GPIO_PinModeSet(LEUART_TX_PORT, LEUART_TX_PIN, gpioModePushPull, 1);
 	// LEUART RXD
 	GPIO_PinModeSet(LEUART_RX_PORT, LEUART_RX_PIN, gpioModeInput, 0);
+	// HM10 STATE, pulled down so an unwired pin reads disconnected
+	GPIO_PinModeSet(HM10_STATE_PORT, HM10_STATE_PIN, gpioModeInputPull, 0);
+}
+
+/**
+ * @brief
+ *	Posts a scheduler event on both edges of a GPIO input
+ * @details
+ *	Uses external interrupt number pin, so only one port can use each pin number. The
+ *	handler reads the pin to find out its level.
+ * @note
+ *	Edge interrupts are asynchronous, they wake the Pearl Gecko from EM0 - EM3
+ * @param[in] port
+ *	GPIO port, the pin must already be an input
+ * @param[in] pin
+ *	GPIO pin
+ * @param[in] event
+ *	scheduler event ID to post on each edge
+ **/
+void gpio_int_open(GPIO_Port_TypeDef port, uint32_t pin, uint32_t event)
+{
+	EFM_ASSERT(pin < GPIO_EXT_INTS);
+	gpio_int_evt[pin] = event;
+	GPIO_ExtIntConfig(port, pin, pin, true, true, true);
+	NVIC_EnableIRQ((pin & 1) ? GPIO_ODD_IRQn : GPIO_EVEN_IRQn);
+}
+
+/**
+ * @brief
+ *	Posts the event of every external interrupt in flags
+ * @param[in] flags
+ *	external interrupt flags, already cleared
+ **/
+static void gpio_int_post(uint32_t flags)
+{
+	while (flags)
+	{
+		uint32_t pin = 31 - __CLZ(flags);
+		add_scheduled_event(gpio_int_evt[pin]);
+		flags &= ~(1u << pin);
+	}
+}
+
+/**
+ * @brief
+ *	Interrupt Routine for the even GPIO external interrupts
+ **/
+void GPIO_EVEN_IRQHandler(void)
+{
+	uint32_t flags = GPIO_IntGetEnabled() & 0x5555;
+	GPIO_IntClear(flags);
+	gpio_int_post(flags);
+}
 
+/**
+ * @brief
+ *	Interrupt Routine for the odd GPIO external interrupts
+ **/
+void GPIO_ODD_IRQHandler(void)
+{
+	uint32_t flags = GPIO_IntGetEnabled() & 0xAAAA;
+	GPIO_IntClear(flags);
+	gpio_int_post(flags);
 }
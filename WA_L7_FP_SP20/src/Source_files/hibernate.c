@@ -0,0 +1,156 @@
+/**
+ * @file hibernate.c
+ * @author William Abrams
+ * @date October 16th, 2026
+ * @brief EM4H hibernation, with application state kept in the RTCC retention registers
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Silicon Lab include files
+#include "em_emu.h"
+#include "em_rmu.h"
+#include "em_core.h"
+#include "em_assert.h"
+
+//** User/developer include files
+#include "hibernate.h"
+#include "soft_timer.h"
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+static bool hibernate_woke;		/**< this boot is a wake-up from EM4H, with valid retained state **/
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/**
+ * @brief
+ *	Checksums the retained state words
+ * @param[in] words
+ *	number of state words, held in RET[1] onward
+ **/
+static uint32_t hibernate_checksum(uint32_t words)
+{
+	uint32_t sum = HIBERNATE_MAGIC | words;
+
+	for (uint32_t i = 1; i <= words; i++)
+		sum = ((sum << 5) | (sum >> 27)) ^ RTCC -> RET[i].REG;
+	return sum;
+}
+
+/**
+ * @brief
+ *	Checks the retention registers for state saved by hibernate_enter()
+ * @returns
+ *	number of state words saved, or 0 if the registers do not hold valid state
+ **/
+static uint32_t hibernate_saved_words(void)
+{
+	uint32_t header = RTCC -> RET[0].REG;
+	uint32_t words = header & 0xFF;
+
+	if ((header & ~0xFFu) != HIBERNATE_MAGIC || words > HIBERNATE_STATE_WORDS)
+		return 0;
+	if (RTCC -> RET[words + 1].REG != hibernate_checksum(words))
+		return 0;
+	return words;
+}
+
+/**
+ * @brief
+ *	Finds out why the Pearl Gecko booted
+ * @details
+ *	Reads and clears the RMU reset cause. A reset caused by an EM4 wake-up, with valid
+ *	state in the retention registers, is a resume: see hibernate_resumed()
+ * @note
+ *	Must be called after soft_timer_open(), the retention registers are part of the RTCC.
+ *	Turns the RTCC EM4 wake-up back off, so it only fires while hibernating.
+ **/
+void hibernate_open(void)
+{
+	uint32_t cause = RMU_ResetCauseGet();
+	RMU_ResetCauseClear();
+
+	hibernate_woke = (cause & RMU_RSTCAUSE_EM4RST) && hibernate_saved_words();
+	RTCC_EM4WakeupEnable(false);
+}
+
+/**
+ * @brief
+ *	Checks if this boot is a wake-up from hibernation
+ * @returns
+ *	true if the part woke from EM4H with retained state, false on a cold boot
+ **/
+bool hibernate_resumed(void)
+{
+	return hibernate_woke;
+}
+
+/**
+ * @brief
+ *	Copies the retained state back out of the retention registers
+ * @param[out] state
+ *	where to copy the state, as passed to hibernate_enter()
+ * @param[in] size
+ *	size of state in bytes, must match what was saved
+ * @returns
+ *	true if state was restored, false if this boot is not a resume or the size differs
+ **/
+bool hibernate_restore(void * state, uint32_t size)
+{
+	uint32_t * words = state;
+	uint32_t count = (size + 3) / 4;
+
+	if (!hibernate_woke || hibernate_saved_words() != count)
+		return false;
+	for (uint32_t i = 0; i < count; i++)
+		words[i] = RTCC -> RET[i + 1].REG;
+	return true;
+}
+
+/**
+ * @brief
+ *	Saves state and hibernates in EM4H until the next soft timer deadline
+ * @details
+ *	Writes state, its size and a checksum to the RTCC retention registers, programs the
+ *	RTCC compare for the nearest soft timer deadline, enables the RTCC as an EM4 wake-up
+ *	source, then enters EM4H. The ULFRCO and RTCC keep running, so the counter is intact
+ *	when the part resets on wake-up.
+ * @note
+ *	Does not return, RAM and CPU state are lost. The next boot sees RMU_RSTCAUSE_EM4RST,
+ *	see hibernate_open(). state must be word aligned, and at most HIBERNATE_STATE_WORDS
+ *	words.
+ * @param[in] state
+ *	application state to retain
+ * @param[in] size
+ *	size of state in bytes
+ **/
+void hibernate_enter(const void * state, uint32_t size)
+{
+	const uint32_t * words = state;
+	uint32_t count = (size + 3) / 4;
+
+	EFM_ASSERT(count <= HIBERNATE_STATE_WORDS);
+	__disable_irq();
+
+	for (uint32_t i = 0; i < count; i++)
+		RTCC -> RET[i + 1].REG = words[i];
+	RTCC -> RET[0].REG = HIBERNATE_MAGIC | count;
+	RTCC -> RET[count + 1].REG = hibernate_checksum(count);
+
+	soft_timer_arm();
+	RTCC_EM4WakeupEnable(true);
+
+	EMU_EM4Init_TypeDef em4_init = EMU_EM4INIT_DEFAULT;
+	em4_init.em4State = emuEM4Hibernate;
+	em4_init.retainUlfrco = true;
+	EMU_EM4Init(&em4_init);
+	EMU_EnterEM4H();
+
+	EFM_ASSERT(false);
+}
@@ -8,8 +8,31 @@
 #include "si7021.h"
 #include "sleep_routines.h"
 #include "scheduler.h"
+#include "em_core.h"
 
-static I2C_PAYLOAD_STRUCT * i2c_payload_s;	/**< Pointer to I2C Payload Struct for the current operation **/
+static I2C_BUS_STRUCT i2c_bus[I2C_BUSES];	/**< Per bus contexts, so I2C0 and I2C1 run in parallel **/
+
+/**
+ * @brief
+ *	Returns the context of an I2C peripheral
+ * @param[in] i2c
+ *	pointer to I2C0 or I2C1
+ **/
+static inline I2C_BUS_STRUCT * i2c_bus_of(I2C_TypeDef * i2c)
+{
+	return &i2c_bus[(i2c == I2C0) ? 0 : 1];
+}
+
+/**
+ * @brief
+ *	Returns the sleep block owner of an I2C peripheral
+ * @param[in] i2c
+ *	pointer to I2C0 or I2C1
+ **/
+static inline sleep_owner_t i2c_sleep_owner(I2C_TypeDef * i2c)
+{
+	return (i2c == I2C0) ? SLEEP_OWNER_I2C0 : SLEEP_OWNER_I2C1;
+}
 
 /**
  * @brief
@@ -96,28 +119,98 @@ void i2c_bus_reset(I2C_TypeDef * i2c, I2C_IO_STRUCT * i2c_io_s)
 	i2c -> CMD = I2C_CMD_ABORT;		// Send the I2C Abort Command
 }
 
+/**
+ * @brief
+ *	Sends a start and the device address, for a write or a read
+ * @param[in] i2c
+ * 	pointer to I2C0 or I2C1
+ * @param[in] i2c_payload_s
+ * 	transaction on the bus
+ * @param[in] dir
+ * 	I2C_DIR_WRITE or I2C_DIR_READ
+ **/
+static inline void i2c_address(I2C_TypeDef * i2c, I2C_PAYLOAD_STRUCT * i2c_payload_s, uint32_t dir)
+{
+	i2c_payload_s -> i2c_state = (dir == I2C_DIR_READ) ? I2C_STATE_ADDRR : I2C_STATE_ADDRW;
+	i2c -> CMD = I2C_CMD_START;
+	i2c -> TXDATA = (i2c_payload_s -> dev_addr << 1) | dir;
+}
+
+/**
+ * @brief
+ *	Puts a transaction on the bus
+ * @details
+ *	Sends the start command, and device address with the appropriate read / write bit:
+ *	a write if the transaction has bytes to write, otherwise a read
+ * @param[in] i2c
+ * 	pointer to I2C0 or I2C1
+ * @param[in] bus
+ * 	context of i2c
+ * @param[in] i2c_payload_s
+ * 	transaction to start
+ **/
+static void i2c_begin(I2C_TypeDef * i2c, I2C_BUS_STRUCT * bus, I2C_PAYLOAD_STRUCT * i2c_payload_s)
+{
+	EFM_ASSERT((i2c -> STATE & _I2C_STATE_STATE_MASK) == I2C_STATE_STATE_IDLE);
+
+	bus -> active = i2c_payload_s;
+	i2c_payload_s -> status = I2C_STATUS_OK;
+	i2c_payload_s -> tx_count = 0;
+	i2c_payload_s -> rx_count = 0;
+	i2c_address(i2c, i2c_payload_s, i2c_payload_s -> tx_len ? I2C_DIR_WRITE : I2C_DIR_READ);
+}
+
 /**
  * @brief
  *	Start function for I2C
  * @details
- *	Sends the start command, and device address with the appropriate read / write bit
+ *	Starts the transaction right away if the bus is idle, otherwise queues it: the
+ *	MSTOP interrupt of each transaction starts the next one, with no trip through the
+ *	scheduler in between
  * @param[in] i2c
  *	Pointer to the I2C Peripheral
  * @param[in] i2c_pl_s
  *	Pointer to the I2C Payload Struct, containing all necessary info for protocol
  * @note
- * 	contains a call to sleep_block_mode()
+ * 	the bus blocks I2C_MASTER_EM_BLOCK from its first transaction until its queue is empty
+ * @returns
+ * 	false if the descriptor is still queued or on the bus, or the queue is full
  **/
-void i2c_start(I2C_TypeDef * i2c, I2C_PAYLOAD_STRUCT * i2c_pl_s)
+bool i2c_start(I2C_TypeDef * i2c, I2C_PAYLOAD_STRUCT * i2c_pl_s)
 {
-	EFM_ASSERT((i2c -> STATE & _I2C_STATE_STATE_MASK) == I2C_STATE_STATE_IDLE);
+	I2C_BUS_STRUCT * bus = i2c_bus_of(i2c);
+	bool started = true;
 
-	sleep_block_mode(I2C_MASTER_EM_BLOCK);
+	EFM_ASSERT(i2c_pl_s -> tx_len || i2c_pl_s -> rx_len);
 
-	i2c_payload_s = i2c_pl_s;
-	i2c_payload_s -> i2c_state = I2C_STATE_START;
-	i2c -> CMD = I2C_CMD_START;
-	i2c -> TXDATA = (i2c_payload_s -> dev_addr << 1) | I2C_DIR_WRITE;
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if (i2c_pl_s -> i2c_state != I2C_STATE_IDLE || bus -> head - bus -> tail == I2C_QUEUE)
+		started = false;
+	else if (bus -> active)
+	{
+		i2c_pl_s -> i2c_state = I2C_STATE_QUEUED;
+		bus -> queue[bus -> head & (I2C_QUEUE - 1)] = i2c_pl_s;
+		bus -> head++;
+	}
+	else
+	{
+		sleep_block_mode(i2c_sleep_owner(i2c), I2C_MASTER_EM_BLOCK);
+		i2c_begin(i2c, bus, i2c_pl_s);
+	}
+	CORE_EXIT_CRITICAL();
+	return started;
+}
+
+/**
+ * @brief
+ *	Checks if a bus has a transaction in progress or queued
+ * @param[in] i2c
+ *	pointer to I2C0 or I2C1
+ **/
+bool i2c_busy(I2C_TypeDef * i2c)
+{
+	return i2c_bus_of(i2c) -> active != NULL;
 }
 
 void i2c_enable_interrupts(I2C_TypeDef * i2c, I2C_IO_STRUCT * i2c_io_s)
@@ -160,24 +253,36 @@ void i2c_disable_bussigs(I2C_TypeDef * i2c)
  * @param[in] i2c
  * 	pointer to I2C0 or I2C1
  **/
-static inline void i2c_ack(I2C_TypeDef * i2c)
+static inline void i2c_ack(I2C_TypeDef * i2c, I2C_BUS_STRUCT * bus)
 {
+	I2C_PAYLOAD_STRUCT * i2c_payload_s = bus -> active;
+
 	switch(i2c_payload_s -> i2c_state)
 	{
-		case I2C_STATE_START:
-			//device is open and ready for measurement
-			i2c_payload_s -> i2c_state = I2C_STATE_CMDW;
-			i2c -> TXDATA = i2c_payload_s -> dev_cmd;
-			break;
-		case I2C_STATE_CMDW:
-			//device measurement command received, ask if ready to tx
-			i2c_payload_s -> i2c_state = I2C_STATE_CMDR;
-			i2c -> CMD = I2C_CMD_START;
-			i2c -> TXDATA = (i2c_payload_s -> dev_addr << 1) | I2C_DIR_READ;
+		case I2C_STATE_ADDRW:
+		case I2C_STATE_TX:
+			//device took the address or the last byte, write the next one
+			if (i2c_payload_s -> tx_count < i2c_payload_s -> tx_len)
+			{
+				i2c_payload_s -> i2c_state = I2C_STATE_TX;
+				i2c -> TXDATA = i2c_payload_s -> tx_buf[i2c_payload_s -> tx_count++];
+			}
+			else if (!i2c_payload_s -> rx_len)
+			{
+				i2c_payload_s -> i2c_state = I2C_STATE_DONE;
+				i2c -> CMD = I2C_CMD_STOP;
+			}
+			else if (i2c_payload_s -> restart)
+				i2c_address(i2c, i2c_payload_s, I2C_DIR_READ);
+			else
+			{
+				i2c_payload_s -> i2c_state = I2C_STATE_RESTART;
+				i2c -> CMD = I2C_CMD_STOP;
+			}
 			break;
-		case I2C_STATE_CMDR:
-			//device is sending MSByte
-			i2c_payload_s -> i2c_state = I2C_STATE_RX_MSB;
+		case I2C_STATE_ADDRR:
+			//device is sending the first byte
+			i2c_payload_s -> i2c_state = I2C_STATE_RX;
 			break;
 		default:
 			EFM_ASSERT(false);
@@ -189,18 +294,32 @@ static inline void i2c_ack(I2C_TypeDef * i2c)
  * @brief
  *	NACK Handler function for I2Cn IRQHandler
  * @details
- *	called by I2Cn IRQHandler, and will perform actions based on the I2C State in the payload struct
+ *	called by I2Cn IRQHandler, and will perform actions based on the I2C State in the payload struct.
+ *	A read address NACK is retried if the descriptor asks for it, any other NACK stops the
+ *	transaction with I2C_STATUS_NACK: it completes at MSTOP like a good one, so the next
+ *	queued transaction still starts.
  * @param[in] i2c
  * 	pointer to I2C0 or I2C1
  **/
-static inline void i2c_nack(I2C_TypeDef * i2c)
+static inline void i2c_nack(I2C_TypeDef * i2c, I2C_BUS_STRUCT * bus)
 {
+	I2C_PAYLOAD_STRUCT * i2c_payload_s = bus -> active;
+
 	switch(i2c_payload_s -> i2c_state)
 	{
-		case I2C_STATE_CMDR:
-			//conversion not complete, ask again
-			i2c -> CMD = I2C_CMD_START;
-			i2c -> TXDATA = (i2c_payload_s -> dev_addr << 1) | I2C_DIR_READ;
+		case I2C_STATE_ADDRR:
+			if (i2c_payload_s -> nack_retry)
+			{
+				//device is busy (e.g. converting), ask again
+				i2c_address(i2c, i2c_payload_s, I2C_DIR_READ);
+				break;
+			}
+			//fall through
+		case I2C_STATE_ADDRW:
+		case I2C_STATE_TX:
+			i2c_payload_s -> status = I2C_STATUS_NACK;
+			i2c_payload_s -> i2c_state = I2C_STATE_DONE;
+			i2c -> CMD = I2C_CMD_STOP;
 			break;
 		default:
 			EFM_ASSERT(false);
@@ -216,21 +335,21 @@ static inline void i2c_nack(I2C_TypeDef * i2c)
  * @param[in] i2c
  * 	pointer to I2C0 or I2C1
  **/
-static inline void i2c_rxdatav(I2C_TypeDef * i2c)
+static inline void i2c_rxdatav(I2C_TypeDef * i2c, I2C_BUS_STRUCT * bus)
 {
+	I2C_PAYLOAD_STRUCT * i2c_payload_s = bus -> active;
+
 	switch(i2c_payload_s -> i2c_state)
 	{
-		case I2C_STATE_RX_MSB:
-			*(i2c_payload_s -> dev_buffer) <<= GENERAL_BYTE_SHIFT;
-			*(i2c_payload_s -> dev_buffer) |= i2c -> RXDATA;
-			i2c_payload_s -> i2c_state = I2C_STATE_RX_LSB;
-			i2c -> CMD = I2C_CMD_ACK;
-			break;
-		case I2C_STATE_RX_LSB:
-			*(i2c_payload_s -> dev_buffer) <<= GENERAL_BYTE_SHIFT;
-			*(i2c_payload_s -> dev_buffer) |= i2c -> RXDATA;
-			i2c_payload_s -> i2c_state = I2C_STATE_DONE;
-			i2c -> CMD = I2C_CMD_NACK | I2C_CMD_STOP;
+		case I2C_STATE_RX:
+			i2c_payload_s -> rx_buf[i2c_payload_s -> rx_count++] = i2c -> RXDATA;
+			if (i2c_payload_s -> rx_count < i2c_payload_s -> rx_len)
+				i2c -> CMD = I2C_CMD_ACK;
+			else
+			{
+				i2c_payload_s -> i2c_state = I2C_STATE_DONE;
+				i2c -> CMD = I2C_CMD_NACK | I2C_CMD_STOP;
+			}
 			break;
 		default:
 			EFM_ASSERT(false);
@@ -243,17 +362,41 @@ static inline void i2c_rxdatav(I2C_TypeDef * i2c)
  *	MSTOP Handler function for I2Cn IRQHandler
  * @details
  *	called by I2Cn IRQHandler, and will perform actions based on the I2C State in the payload struct
+ * @note
+ *	the status and the first received bytes are posted with the device event, so
+ *	back-to-back transfers of a short reading are not lost. The next queued transaction
+ *	starts right here.
  * @param[in] i2c
  * 	pointer to I2C0 or I2C1
  **/
-static inline void i2c_mstop(I2C_TypeDef * i2c)
+static inline void i2c_mstop(I2C_TypeDef * i2c, I2C_BUS_STRUCT * bus)
 {
+	I2C_PAYLOAD_STRUCT * i2c_payload_s = bus -> active;
+	uint32_t payload = 0;
+
 	switch(i2c_payload_s -> i2c_state)
 	{
+		case I2C_STATE_RESTART:
+			//write done and the bus released, now read
+			i2c_address(i2c, i2c_payload_s, I2C_DIR_READ);
+			break;
 		case I2C_STATE_DONE:
+			for (uint32_t i = 0; i < i2c_payload_s -> rx_count && i < I2C_PAYLOAD_BYTES; i++)
+				payload = (payload << GENERAL_BYTE_SHIFT) | i2c_payload_s -> rx_buf[i];
+			payload |= (uint32_t)i2c_payload_s -> status << I2C_PAYLOAD_STATUS_SHIFT;
 			i2c_payload_s -> i2c_state = I2C_STATE_IDLE;
-			add_scheduled_event(i2c_payload_s -> dev_evt);
-			sleep_unblock_mode(I2C_MASTER_EM_BLOCK);
+			if (i2c_payload_s -> dev_evt)
+				post_scheduled_event(i2c_payload_s -> dev_evt, payload);
+			if (bus -> tail != bus -> head)
+			{
+				i2c_begin(i2c, bus, bus -> queue[bus -> tail & (I2C_QUEUE - 1)]);
+				bus -> tail++;
+			}
+			else
+			{
+				bus -> active = NULL;
+				sleep_unblock_mode(i2c_sleep_owner(i2c), I2C_MASTER_EM_BLOCK);
+			}
 			break;
 		default:
 			EFM_ASSERT(false);
@@ -272,15 +415,17 @@ void I2C0_IRQHandler(void)
 	__disable_irq();
 
 	uint32_t iflags = (I2C0 -> IFC = I2C0 -> IF) & I2C0 -> IEN;
+	I2C_BUS_STRUCT * bus = &i2c_bus[0];
 
+	EFM_ASSERT(!iflags || bus -> active);
 	if (iflags & I2C_IF_ACK)
-		i2c_ack(I2C0);
+		i2c_ack(I2C0, bus);
 	if (iflags & I2C_IF_NACK)
-		i2c_nack(I2C0);
+		i2c_nack(I2C0, bus);
 	if (iflags & I2C_IF_RXDATAV)
-		i2c_rxdatav(I2C0);
+		i2c_rxdatav(I2C0, bus);
 	if (iflags & I2C_IF_MSTOP)
-		i2c_mstop(I2C0);
+		i2c_mstop(I2C0, bus);
 
 	__enable_irq();
 }
@@ -296,15 +441,17 @@ void I2C1_IRQHandler(void)
 	__disable_irq();
 
 	uint32_t iflags = (I2C1 -> IFC = I2C1 -> IF) & I2C1 -> IEN;
+	I2C_BUS_STRUCT * bus = &i2c_bus[1];
 
+	EFM_ASSERT(!iflags || bus -> active);
 	if (iflags & I2C_IF_ACK)
-		i2c_ack(I2C1);
+		i2c_ack(I2C1, bus);
 	if (iflags & I2C_IF_NACK)
-		i2c_nack(I2C1);
+		i2c_nack(I2C1, bus);
 	if (iflags & I2C_IF_RXDATAV)
-		i2c_rxdatav(I2C1);
+		i2c_rxdatav(I2C1, bus);
 	if (iflags & I2C_IF_MSTOP)
-		i2c_mstop(I2C1);
+		i2c_mstop(I2C1, bus);
 
 	__enable_irq();
 }
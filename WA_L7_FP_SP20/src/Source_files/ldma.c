@@ -1,29 +1,114 @@
+/**
+ * @file ldma.c
+ * @author William Abrams
+ * @date October 16th, 2026
+ * @brief LDMA driver, shared by the peripherals that move data without the CPU
+ **/
+
 #include "ldma.h"
-#include "em_ldma.h"
+#include "em_assert.h"
 #include <stdbool.h>
 
-//TODO: support multiple LDMA transfers at a time (as they are independent of each other, maybe keep track of what each channel is being used for or scheduled events?)
+static bool ldma_opened = false;	/**< LDMA_Init() has been called **/
 
-void ldma_open(ldma_channel_t channel)
+/**
+ * @brief
+ *	Opener function for the LDMA
+ * @details
+ *	Enables the LDMA clock and IRQ through LDMA_Init(), only the first call does anything
+ * @note
+ *	Every driver that uses a channel calls this, so the LDMA is brought up by whichever
+ *	opens first
+ **/
+void ldma_open(void)
 {
+	if (ldma_opened)
+		return;
+
 	LDMA_Init_t ldma_init = LDMA_INIT_DEFAULT;
 	LDMA_Init(&ldma_init);
+	ldma_opened = true;
 }
-void ldma_start(ldma_channel_t channel, LDMA_TransferCfg_t * ldma_transfercfg, LDMA_Descriptor_t * ldma_descriptor)
+
+/**
+ * @brief
+ *	Starts a transfer on an LDMA channel
+ * @param[in] channel
+ *	LDMA channel to use
+ * @param[in] ldma_transfercfg
+ *	transfer configuration, selects the peripheral request signal
+ * @param[in] ldma_descriptor
+ *	first descriptor of the transfer, must stay valid until the transfer is done
+ * @note
+ *	A descriptor with doneIfs cleared never raises the LDMA interrupt, the peripheral's
+ *	own interrupt (e.g. LEUART TXC) is used to find out when it is done
+ **/
+void ldma_start(ldma_channel_t channel, const LDMA_TransferCfg_t * ldma_transfercfg, const LDMA_Descriptor_t * ldma_descriptor)
 {
+	EFM_ASSERT(ldma_opened && channel < LDMA_CHANNELS);
 	LDMA_StartTransfer(channel, ldma_transfercfg, ldma_descriptor);
 }
 
+/**
+ * @brief
+ *	Stops a transfer on an LDMA channel
+ * @param[in] channel
+ *	LDMA channel to stop
+ **/
+void ldma_stop(ldma_channel_t channel)
+{
+	EFM_ASSERT(channel < LDMA_CHANNELS);
+	LDMA_StopTransfer(channel);
+}
+
+/**
+ * @brief
+ *	Checks if an LDMA channel is still transferring
+ * @param[in] channel
+ *	LDMA channel to check
+ * @returns
+ *	true while the channel has not finished its descriptor list
+ **/
+bool ldma_busy(ldma_channel_t channel)
+{
+	EFM_ASSERT(channel < LDMA_CHANNELS);
+	return !LDMA_TransferDone(channel);
+}
+
+/**
+ * @brief
+ *	Returns where an LDMA channel writes next
+ * @details
+ *	The channel's DST register moves along with the transfer, so a peripheral to memory
+ *	transfer can be checked for how far it got without waiting for it to finish
+ * @param[in] channel
+ *	LDMA channel to check
+ * @returns
+ *	address of the next destination byte
+ **/
+uint32_t ldma_dst(ldma_channel_t channel)
+{
+	EFM_ASSERT(channel < LDMA_CHANNELS);
+	return LDMA -> CH[channel].DST;
+}
+
+/**
+ * @brief
+ * 	LDMA's IRQ Handler
+ * @details
+ * 	Clears interrupt flags, and disables the interrupt of every channel that finished
+ * @note
+ * 	A bus error on any channel is a driver bug, and asserts
+ **/
 void LDMA_IRQHandler(void)
 {
 	__disable_irq();
 
-	uint32_t iflags = (LDMA -> IFC = LDMA -> IF) & LDMA -> IEN;
-	//FIXME: generic for only LEUART TX but eh
-	if (iflags & (1 << LDMA_CHANNEL_LEUART_TX))
-	{
-		LDMA -> IEN &= ~(1 << LDMA_CHANNEL_LEUART_TX);
-	}
+	uint32_t iflags = LDMA -> IF & LDMA -> IEN;
+	LDMA -> IFC = iflags;
+
+	EFM_ASSERT(!(iflags & LDMA_IF_ERROR));
+	LDMA -> IEN &= ~(iflags & ~LDMA_IF_ERROR);
 
 	__enable_irq();
 }
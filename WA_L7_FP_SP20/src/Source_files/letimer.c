@@ -118,7 +118,7 @@ void letimer_pwm_open(LETIMER_TypeDef * letimer, APP_LETIMER_PWM_TypeDef *app_le
 	NVIC_EnableIRQ(LETIMER0_IRQn);
 
 	if (letimer -> STATUS & LETIMER_STATUS_RUNNING)
-		sleep_block_mode(LETIMER_EM);
+		sleep_block_mode(SLEEP_OWNER_LETIMER0, LETIMER_EM);
 }
 
 /**
@@ -148,9 +148,9 @@ void letimer_start(LETIMER_TypeDef * letimer, bool enable)
 	while (letimer -> SYNCBUSY);
 
 	if (enable && !(letimer -> STATUS & LETIMER_STATUS_RUNNING))
-		sleep_block_mode(LETIMER_EM);
+		sleep_block_mode(SLEEP_OWNER_LETIMER0, LETIMER_EM);
 	if (!enable && (letimer -> STATUS & LETIMER_STATUS_RUNNING))
-		sleep_unblock_mode(LETIMER_EM);
+		sleep_unblock_mode(SLEEP_OWNER_LETIMER0, LETIMER_EM);
 
 	LETIMER_Enable(letimer, enable);
 	while (letimer -> SYNCBUSY);
@@ -9,7 +9,9 @@
 #include <stdbool.h>
 #include "em_gpio.h"
 #include "em_cmu.h"
+#include "em_core.h"
 #include "leuart.h"
+#include "ldma.h"
 #include "scheduler.h"
 
 static uint32_t * rx_done_evt;							/**< Scheduler event ID for RX Done event **/
@@ -19,16 +21,99 @@ static leuart_txstate_t txstate = LEUART_STATE_TX_IDLE; /**< State Machine state
 static volatile bool leuart0_txbusy = false;			/**< Status boolean, acts as weak mutex **/
 static char * txstring;									/**< Pointer, to next char to be transmitted **/
 static uint32_t txcnt = 0;								/**< Counter variable, of characters left to transmit **/
+static char * txnext;									/**< Pointer, to the second segment of the transmission **/
+static uint32_t txnextcnt = 0;							/**< Counter variable, of characters in the second segment **/
 
 
 static leuart_rxstate_t rxstate = LEUART_STATE_RX_IDLE; /**< State Machine state variable for receiving **/
-static char * rxstring;									/**< Receiving String, where we write RXDATA to **/
-static uint32_t rxlen;									/**< Counter helper, length of rxstring **/
+static RING_STRUCT * rx_ring;							/**< Receiving ring, RXDATA is staged past its head until SIGF **/
 static uint32_t rxcnt = 0;								/**< Counter variable, of characters received so far **/
+static bool rxoverflow = false;							/**< frame did not fit in rx_ring, it is dropped on SIGF **/
+static uint32_t rxdrops = 0;							/**< frames dropped because they did not fit in rx_ring **/
 
 
-static bool leuart_tx_dma = false;						/**< TODO: Unused, for future implementation using LDMA **/
-static bool leuart_rx_dma = false;						/**< TODO: Unused, for future implementation using LDMA **/
+static bool leuart_tx_dma = false;						/**< transmit through LDMA_CHANNEL_LEUART_TX instead of TXBL interrupts **/
+static bool leuart_rx_dma = false;						/**< receive through LDMA_CHANNEL_LEUART_RX into rx_ring, waking only on SIGF **/
+static LDMA_Descriptor_t tx_descriptor[2];				/**< LDMA descriptors of the transmission in progress, one per segment **/
+static LDMA_Descriptor_t rx_descriptor[2];				/**< LDMA descriptors of the free space in rx_ring, one per contiguous run **/
+static uint32_t rx_armed = 0;							/**< bytes of rx_ring handed to LDMA, 0 if RX DMA is not running **/
+static char rxsigframe;									/**< SIGF character, the last byte of every complete frame **/
+static bool rxblock = true;								/**< block RX after SIGF until the next STARTF **/
+
+/**
+ * @brief
+ *	Hands all of the free space in rx_ring to LDMA_CHANNEL_LEUART_RX
+ * @details
+ *	The free space past the head is at most two contiguous runs, one linked descriptor
+ *	each. Neither raises an LDMA interrupt, the received bytes are collected on SIGF.
+ * @note
+ *	LDMA never writes past the free space, so a full ring drops frames instead of
+ *	overwriting unread ones. If the ring is full nothing is armed, see leuart_rx_resume().
+ **/
+static void leuart_rx_dma_arm(void)
+{
+	uint8_t * span0;
+	uint32_t len0 = ring_write_span(rx_ring, &span0);
+	uint32_t len1 = ring_space(rx_ring) - len0;
+
+	rx_armed = len0 + len1;
+	if (!rx_armed)
+		return;
+
+	LDMA_TransferCfg_t rx_cfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_LEUART0_RXDATAV);
+	if (len1)
+	{
+		rx_descriptor[0] = (LDMA_Descriptor_t)LDMA_DESCRIPTOR_LINKREL_P2M_BYTE(&LEUART0 -> RXDATA, span0, len0, 1);
+		rx_descriptor[1] = (LDMA_Descriptor_t)LDMA_DESCRIPTOR_SINGLE_P2M_BYTE(&LEUART0 -> RXDATA, ring_write_at(rx_ring, len0), len1);
+		rx_descriptor[1].xfer.doneIfs = 0;
+	}
+	else
+		rx_descriptor[0] = (LDMA_Descriptor_t)LDMA_DESCRIPTOR_SINGLE_P2M_BYTE(&LEUART0 -> RXDATA, span0, len0);
+	rx_descriptor[0].xfer.doneIfs = 0;
+	ldma_start(LDMA_CHANNEL_LEUART_RX, &rx_cfg, &rx_descriptor[0]);
+}
+
+/**
+ * @brief
+ *	Collects the frame LDMA received, on SIGF
+ * @details
+ *	Blocks RX until the next STARTF, stops the channel and works out how far it wrote.
+ *	A frame that ends in SIGF is committed to rx_ring, anything else (the free space ran
+ *	out mid frame) is dropped. The channel is then re-armed over the free space.
+ * @note
+ *	SIGF is flagged as the byte lands in RXDATA, LDMA may not have moved it yet
+ * @returns
+ *	true if a frame was committed
+ **/
+static bool leuart_rx_dma_frame(void)
+{
+	uint32_t received = rx_armed;
+	uint8_t * last;
+	bool complete;
+
+	if (rxblock)
+		LEUART0 -> CMD = LEUART_CMD_RXBLOCKEN;
+	if (rx_armed)
+	{
+		while ((LEUART0 -> STATUS & LEUART_STATUS_RXDATAV) && ldma_busy(LDMA_CHANNEL_LEUART_RX));
+		ldma_stop(LDMA_CHANNEL_LEUART_RX);
+		if (ldma_busy(LDMA_CHANNEL_LEUART_RX))
+			received = (ldma_dst(LDMA_CHANNEL_LEUART_RX) - (uint32_t)ring_write_at(rx_ring, 0)) & rx_ring -> mask;
+	}
+
+	last = received ? ring_write_at(rx_ring, received - 1) : NULL;
+	complete = last && *last == rxsigframe;
+	if (complete)
+		ring_write_commit(rx_ring, received);
+	else
+	{
+		LEUART0 -> CMD = LEUART_CMD_CLEARRX;
+		rxdrops++;
+	}
+
+	leuart_rx_dma_arm();
+	return complete;
+}
 
 /**
  * @brief
@@ -76,9 +161,11 @@ void leuart_open(LEUART_TypeDef * leuart, LEUART_OPEN_STRUCT * leuart_settings)
 	leuart -> ROUTEPEN = leuart_settings -> rx_rpen | leuart_settings -> tx_rpen;
 
 	// RX STRING
-	sleep_block_mode(LEUART_RX_EM_BLOCK); //FIXME: this should not be done here
-	rxstring = leuart_settings -> rxstring;
-	rxlen = leuart_settings -> rxlen;
+	sleep_block_mode(SLEEP_OWNER_LEUART0_RX, LEUART_RX_EM_BLOCK); //FIXME: this should not be done here
+	rx_ring = leuart_settings -> rx_ring;
+	rxdrops = 0;
+	rxsigframe = leuart_settings -> sigframe;
+	rxblock = leuart_settings -> rxblocken;
 
 	// MISC Setup
 	leuart -> CMD = (LEUART_CMD_RXBLOCKEN * leuart_settings -> rxblocken);
@@ -114,12 +201,22 @@ void leuart_open(LEUART_TypeDef * leuart, LEUART_OPEN_STRUCT * leuart_settings)
 	// Pass off to DMA
 	leuart_rx_dma = leuart_settings -> rx_dma;
 	leuart_tx_dma = leuart_settings -> tx_dma;
-//TODO:	LEUART_RxDmaInEM2Enable(leuart, leuart_rx_dma);
-//	LEUART_TxDmaInEM2Enable(leuart, leuart_tx_dma);
+	if (leuart_tx_dma || leuart_rx_dma)
+		ldma_open();
+	LEUART_RxDmaInEM2Enable(leuart, leuart_rx_dma);
+	LEUART_TxDmaInEM2Enable(leuart, leuart_tx_dma);
 
 	// Setup for Interrupts
 	leuart -> IFC = leuart -> IF; //TODO: no sigf interrupt until startf
-	leuart -> IEN = (LEUART_IEN_STARTF * leuart_settings -> startframe_en) | (LEUART_IEN_RXDATAV * leuart_settings -> rxdatav_en);
+	if (leuart_rx_dma)
+	{
+		//LDMA takes every byte, wake on SIGF only
+		rx_armed = 0;
+		leuart_rx_dma_arm();
+		leuart -> IEN = LEUART_IEN_SIGF;
+	}
+	else
+		leuart -> IEN = (LEUART_IEN_STARTF * leuart_settings -> startframe_en) | (LEUART_IEN_RXDATAV * leuart_settings -> rxdatav_en);
 	if (leuart == LEUART0)
 		NVIC_EnableIRQ(LEUART0_IRQn);
 }
@@ -129,7 +226,9 @@ void leuart_open(LEUART_TypeDef * leuart, LEUART_OPEN_STRUCT * leuart_settings)
  * @details
  * 	Clears interrupt flags, handles enabled interrupts
  * @note
- * 	Despite containing options for SIGF and STARTF, these are NYI
+ * 	A received frame is staged past the head of rx_ring and only committed on SIGF, so
+ * 	main never sees a partial frame. A frame that does not fit is dropped whole. With
+ * 	rx_dma, LDMA stages the bytes and SIGF is the only RX interrupt.
  **/
 void LEUART0_IRQHandler(void)
 {
@@ -142,14 +241,14 @@ void LEUART0_IRQHandler(void)
 		switch (rxstate)
 		{
 			case LEUART_STATE_RX_IDLE:
-				memset(rxstring,0,rxlen); //purge all rx data
-				rxcnt = 0;
+				rxcnt = 0; //nothing was committed, so this purges the staged frame
+				rxoverflow = false;
 				rxstate = LEUART_STATE_RX_RECEIVE;
 				LEUART0 -> IEN |= LEUART_IEN_SIGF;
 				break;
 			case LEUART_STATE_RX_RECEIVE:
-				memset(rxstring,0,rxlen); //purge all rx data
 				rxcnt = 0;
+				rxoverflow = false;
 				break;
 			default:
 				EFM_ASSERT(false);
@@ -164,17 +263,28 @@ void LEUART0_IRQHandler(void)
 				EFM_ASSERT(false);
 				break;
 			case LEUART_STATE_RX_RECEIVE:
-				rxstring[rxcnt] = LEUART0 -> RXDATA;
-				rxcnt++;
-				//rxcnt is valid from 0 to rxlen - 1
-				if (rxcnt >= rxlen)
-					rxcnt = 1;
+			{
+				uint8_t * slot = ring_write_at(rx_ring, rxcnt);
+				uint8_t data = LEUART0 -> RXDATA;
+				if (slot)
+				{
+					*slot = data;
+					rxcnt++;
+				}
+				else
+					rxoverflow = true;
 				break;
+			}
 			default:
 				EFM_ASSERT(false);
 		}
 	}
-	if (iflags & LEUART_IF_SIGF)
+	if ((iflags & LEUART_IF_SIGF) && leuart_rx_dma)
+	{
+		if (leuart_rx_dma_frame())
+			add_scheduled_event(*rx_done_evt);
+	}
+	else if (iflags & LEUART_IF_SIGF)
 	{
 		switch (rxstate)
 		{
@@ -183,10 +293,16 @@ void LEUART0_IRQHandler(void)
 				break;
 			case LEUART_STATE_RX_RECEIVE:
 				//done reading:
-				LEUART0 -> CMD = LEUART_CMD_RXBLOCKEN | LEUART_CMD_CLEARRX;
+				LEUART0 -> CMD = (rxblock ? LEUART_CMD_RXBLOCKEN : 0) | LEUART_CMD_CLEARRX;
 				LEUART0 -> IEN &= ~LEUART_IEN_SIGF;
 				rxstate = LEUART_STATE_RX_IDLE;
-				add_scheduled_event(*rx_done_evt);
+				if (!rxoverflow)
+				{
+					ring_write_commit(rx_ring, rxcnt);
+					add_scheduled_event(*rx_done_evt);
+				}
+				else
+					rxdrops++;
 				break;
 			default:
 				EFM_ASSERT(false);
@@ -197,6 +313,13 @@ void LEUART0_IRQHandler(void)
 		switch (txstate)
 		{
 			case LEUART_STATE_TX_TRANSMIT:
+				if (!txcnt && txnextcnt)
+				{
+					//first segment done, move on to the second
+					txstring = txnext;
+					txcnt = txnextcnt;
+					txnextcnt = 0;
+				}
 				if (txcnt > 0)
 				{
 					LEUART0 -> TXDATA = *txstring;
@@ -228,7 +351,7 @@ void LEUART0_IRQHandler(void)
 				LEUART0 -> IEN &= ~LEUART_IEN_TXC;
 				leuart0_txbusy = false;
 				add_scheduled_event(*tx_done_evt);
-				sleep_unblock_mode(LEUART_TX_EM_BLOCK);
+				sleep_unblock_mode(SLEEP_OWNER_LEUART0_TX, LEUART_TX_EM_BLOCK);
 				break;
 			case LEUART_STATE_TX_IDLE:
 			case LEUART_STATE_TX_TRANSMIT:
@@ -246,7 +369,7 @@ void LEUART0_IRQHandler(void)
  * @brief
  *	Starts a transmission over LEUART
  * @details
- *  Blocks sleep, sets the mutex, and begins transmission.
+ *  Transmits a single segment, see leuart_start_segments()
  * @param[in] leuart
  *  LEUART peripheral to transmit over
  * @param[in] string
@@ -255,20 +378,97 @@ void LEUART0_IRQHandler(void)
  * 	Length of the input string
  * @details
  * 	If string is declared on the stack and not the heap, it will disappear and cause leaurt to transmit incorrectly
+ * @returns
+ * 	false if a transmission is already in progress or string_len is 0 (nothing is started)
  */
-void leuart_start(LEUART_TypeDef * leuart, char * string, uint32_t string_len)
+bool leuart_start(LEUART_TypeDef * leuart, char * string, uint32_t string_len)
 {
-	//wait till not busy
-	while(leuart_tx_busy(leuart));
+	return leuart_start_segments(leuart, string, string_len, NULL, 0);
+}
+
+/**
+ * @brief
+ *	Starts a transmission of up to two segments over LEUART
+ * @details
+ *  Blocks sleep, sets the mutex, and begins transmission. The second segment is sent
+ *  right after the first, so a packet that wraps the end of a circular buffer goes out
+ *  as one transmission without being copied.
+ *  With tx_dma, the segments are handed to LDMA_CHANNEL_LEUART_TX as two linked
+ *  descriptors, which feed TXDATA on TXBL requests (also in EM2), and the only interrupt
+ *  taken is TXC at the end. Otherwise every byte is written from the TXBL interrupt.
+ * @param[in] leuart
+ *  LEUART peripheral to transmit over
+ * @param[in] string0
+ * 	Pointer to the first segment
+ * @param[in] len0
+ * 	Length of the first segment
+ * @param[in] string1
+ * 	Pointer to the second segment, ignored if len1 is 0
+ * @param[in] len1
+ * 	Length of the second segment, 0 for a single segment
+ * @note
+ * 	Both segments must stay untouched until the TX done event.
+ * 	Never waits for a transmission in progress, check leuart_tx_busy() or the TX done
+ * 	event first.
+ * 	An empty transfer is refused: no byte would go out, so TXC would never come to
+ * 	release the mutex.
+ * @returns
+ * 	false if a transmission is already in progress or both segments are empty (nothing
+ * 	is started)
+ */
+bool leuart_start_segments(LEUART_TypeDef * leuart, char * string0, uint32_t len0, char * string1, uint32_t len1)
+{
+	if (!len0 && !len1)
+		return false;
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if (leuart_tx_busy(leuart))
+	{
+		CORE_EXIT_CRITICAL();
+		return false;
+	}
 	leuart0_txbusy = true;
+	CORE_EXIT_CRITICAL();
+
 	//block sleep
-	sleep_block_mode(LEUART_TX_EM_BLOCK);
+	sleep_block_mode(SLEEP_OWNER_LEUART0_TX, LEUART_TX_EM_BLOCK);
+	if (!len0)
+	{
+		//only a second segment, send it as the first
+		string0 = string1;
+		len0 = len1;
+		len1 = 0;
+	}
+	if (leuart_tx_dma)
+	{
+		//LDMA feeds TXDATA, wait for TXC only
+		EFM_ASSERT(len0);
+		LDMA_TransferCfg_t tx_cfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_LEUART0_TXBL);
+		if (len1)
+		{
+			tx_descriptor[0] = (LDMA_Descriptor_t)LDMA_DESCRIPTOR_LINKREL_M2P_BYTE(string0, &leuart -> TXDATA, len0, 1);
+			tx_descriptor[1] = (LDMA_Descriptor_t)LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(string1, &leuart -> TXDATA, len1);
+			tx_descriptor[1].xfer.doneIfs = 0;
+		}
+		else
+			tx_descriptor[0] = (LDMA_Descriptor_t)LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(string0, &leuart -> TXDATA, len0);
+		tx_descriptor[0].xfer.doneIfs = 0;
+		txstate = LEUART_STATE_TX_DONE;
+		leuart -> IFC = LEUART_IFC_TXC;
+		leuart -> IEN |= LEUART_IEN_TXC;
+		ldma_start(LDMA_CHANNEL_LEUART_TX, &tx_cfg, &tx_descriptor[0]);
+		return true;
+	}
 	//copy over tx information
-	txstring = string;
-	txcnt = string_len;
+	txstring = string0;
+	txcnt = len0;
+	txnext = string1;
+	txnextcnt = len1;
 	txstate = LEUART_STATE_TX_TRANSMIT;
 	//enable TXBL (should hit immediately)
 	leuart -> IEN |= LEUART_IEN_TXBL;
+	return true;
 }
 
 /**
@@ -292,12 +492,80 @@ bool leuart_tx_busy(LEUART_TypeDef * leuart)
  * @returns
  * 	Returns true if RX operation already in progress
  * 	Returns false if RX is idle (not in use)
+ * @note
+ * 	With rx_dma there is no STARTF interrupt, a frame is in progress while RX is unblocked.
+ * 	Without RX blocking (see leuart_rx_frame()) there is no way to tell, so it is never busy.
  **/
 bool leuart_rx_busy()
 {
+	if (leuart_rx_dma)
+		return rxblock && !(LEUART0 -> STATUS & LEUART_STATUS_RXBLOCK);
 	return !(rxstate == LEUART_STATE_RX_IDLE);
 }
 
+/**
+ * @brief
+ *	Changes the frame characters of LEUART0 RX
+ * @details
+ *	Lets a protocol without '<' '>' framing (e.g. HM-10 AT responses) reuse the frame
+ *	machinery. With block false every byte is received, and a frame is whatever arrived
+ *	up to and including each SIGF.
+ * @note
+ *	Call between frames, a frame in progress may be split or dropped
+ * @param[in] leuart
+ *  Pointer to the LEUART peripheral
+ * @param[in] startframe
+ *	STARTF character, unblocks RX
+ * @param[in] sigframe
+ *	SIGF character, ends a frame
+ * @param[in] block
+ *	block RX after each SIGF until the next STARTF
+ **/
+void leuart_rx_frame(LEUART_TypeDef * leuart, char startframe, char sigframe, bool block)
+{
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+
+	while (leuart -> SYNCBUSY & (LEUART_SYNCBUSY_STARTFRAME | LEUART_SYNCBUSY_SIGFRAME | LEUART_SYNCBUSY_CMD));
+	leuart -> STARTFRAME = startframe;
+	leuart -> SIGFRAME = sigframe;
+	leuart -> CMD = block ? LEUART_CMD_RXBLOCKEN : LEUART_CMD_RXBLOCKDIS;
+	rxsigframe = sigframe;
+	rxblock = block;
+
+	CORE_EXIT_CRITICAL();
+}
+
+/**
+ * @brief
+ *	Returns the number of received frames lost to a full rx_ring
+ * @returns
+ *	frames dropped since leuart_open()
+ **/
+uint32_t leuart_rx_drops(void)
+{
+	return rxdrops;
+}
+
+/**
+ * @brief
+ *	Re-arms RX DMA once the consumer has freed space in a full rx_ring
+ * @details
+ *	Called after reading from rx_ring. Does nothing unless RX DMA stopped for lack of
+ *	space, otherwise the space freed is picked up on the next SIGF.
+ **/
+void leuart_rx_resume(void)
+{
+	if (!leuart_rx_dma)
+		return;
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if (!rx_armed)
+		leuart_rx_dma_arm();
+	CORE_EXIT_CRITICAL();
+}
+
 /**
  * @brief
  *   LEUART STATUS function returns the STATUS of the peripheral for the
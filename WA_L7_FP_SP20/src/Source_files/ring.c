@@ -0,0 +1,332 @@
+/**
+ * @file ring.c
+ * @author William Abrams
+ * @date October 16th, 2026
+ * @brief Lock-free single producer / single consumer byte ring buffer
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Silicon Lab include files
+#include "em_device.h"
+#include "em_assert.h"
+
+//** User/developer include files
+#include "ring.h"
+#include <string.h>
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/**
+ * @brief
+ *	Initializes a ring buffer, empty
+ * @param[in] ring
+ *	ring to initialize
+ * @param[in] buf
+ *	storage for the ring, size bytes
+ * @param[in] size
+ *	size of buf, MUST BE POWER OF 2
+ **/
+void ring_init(RING_STRUCT * ring, uint8_t * buf, uint32_t size)
+{
+	EFM_ASSERT(size && !(size & (size - 1)));
+	ring -> buf = buf;
+	ring -> size = size;
+	ring -> mask = size - 1;
+	ring -> head = ring -> tail = 0;
+}
+
+/**
+ * @brief
+ *	Returns the number of bytes in a ring
+ **/
+uint32_t ring_count(const RING_STRUCT * ring)
+{
+	return ring -> head - ring -> tail;
+}
+
+/**
+ * @brief
+ *	Returns the number of bytes that can be written to a ring
+ **/
+uint32_t ring_space(const RING_STRUCT * ring)
+{
+	return ring -> size - (ring -> head - ring -> tail);
+}
+
+/**
+ * @brief
+ *	Returns the longest contiguous run of readable bytes
+ * @details
+ *	For DMA, or any other bulk consumer: the bytes from offset on, up to the end of buf or
+ *	of the data, whichever comes first. Release them with ring_read_commit().
+ * @param[in] ring
+ *	ring to read
+ * @param[in] offset
+ *	bytes past the tail to start at
+ * @param[out] span
+ *	start of the run
+ * @returns
+ *	length of the run, 0 if there is no data past offset
+ **/
+uint32_t ring_read_span(const RING_STRUCT * ring, uint32_t offset, uint8_t ** span)
+{
+	uint32_t count = ring -> head - ring -> tail;
+	__DMB();
+	if (offset >= count)
+		return 0;
+
+	uint32_t index = (ring -> tail + offset) & ring -> mask;
+	uint32_t len = count - offset;
+	if (len > ring -> size - index)
+		len = ring -> size - index;
+	*span = &ring -> buf[index];
+	return len;
+}
+
+/**
+ * @brief
+ *	Returns the longest contiguous run of free bytes
+ * @details
+ *	For DMA, or any other bulk producer: the free bytes from the head on, up to the end of
+ *	buf or of the free space, whichever comes first. Publish them with ring_write_commit().
+ * @param[in] ring
+ *	ring to write
+ * @param[out] span
+ *	start of the run
+ * @returns
+ *	length of the run, 0 if the ring is full
+ **/
+uint32_t ring_write_span(const RING_STRUCT * ring, uint8_t ** span)
+{
+	uint32_t space = ring -> size - (ring -> head - ring -> tail);
+	uint32_t index = ring -> head & ring -> mask;
+
+	if (space > ring -> size - index)
+		space = ring -> size - index;
+	*span = &ring -> buf[index];
+	return space;
+}
+
+/**
+ * @brief
+ *	Releases bytes read from the tail
+ * @note
+ *	The barrier keeps the reads of the data before the tail moves, so the producer
+ *	cannot overwrite bytes still being read
+ * @param[in] ring
+ *	ring to update
+ * @param[in] len
+ *	bytes to release, no more than ring_count()
+ **/
+void ring_read_commit(RING_STRUCT * ring, uint32_t len)
+{
+	EFM_ASSERT(len <= ring -> head - ring -> tail);
+	__DMB();
+	ring -> tail += len;
+}
+
+/**
+ * @brief
+ *	Publishes bytes written at the head
+ * @note
+ *	The barrier makes the data visible before the head moves, so the consumer never
+ *	reads stale bytes
+ * @param[in] ring
+ *	ring to update
+ * @param[in] len
+ *	bytes to publish, no more than ring_space()
+ **/
+void ring_write_commit(RING_STRUCT * ring, uint32_t len)
+{
+	EFM_ASSERT(len <= ring -> size - (ring -> head - ring -> tail));
+	__DMB();
+	ring -> head += len;
+}
+
+/**
+ * @brief
+ *	Takes back the newest bytes written, as if they had never been published
+ * @note
+ *	Only safe when producer and consumer run in the same context, otherwise the consumer
+ *	may already be reading them
+ * @param[in] ring
+ *	ring to update
+ * @param[in] len
+ *	bytes to take back, no more than ring_count()
+ **/
+void ring_unwrite(RING_STRUCT * ring, uint32_t len)
+{
+	EFM_ASSERT(len <= ring -> head - ring -> tail);
+	ring -> head -= len;
+}
+
+/**
+ * @brief
+ *	Returns a pointer to a byte in the ring's data
+ * @param[in] ring
+ *	ring to read
+ * @param[in] offset
+ *	bytes past the tail
+ * @returns
+ *	pointer to the byte, or NULL if offset is past the data
+ **/
+uint8_t * ring_read_at(const RING_STRUCT * ring, uint32_t offset)
+{
+	if (offset >= ring -> head - ring -> tail)
+		return NULL;
+	__DMB();
+	return &ring -> buf[(ring -> tail + offset) & ring -> mask];
+}
+
+/**
+ * @brief
+ *	Returns a pointer to a free byte, for the producer to stage data before committing it
+ * @param[in] ring
+ *	ring to write
+ * @param[in] offset
+ *	bytes past the head
+ * @returns
+ *	pointer to the byte, or NULL if offset is past the free space
+ **/
+uint8_t * ring_write_at(const RING_STRUCT * ring, uint32_t offset)
+{
+	if (offset >= ring -> size - (ring -> head - ring -> tail))
+		return NULL;
+	return &ring -> buf[(ring -> head + offset) & ring -> mask];
+}
+
+/**
+ * @brief
+ *	Writes as many bytes as fit to a ring
+ * @param[in] ring
+ *	ring to write
+ * @param[in] data
+ *	bytes to write
+ * @param[in] len
+ *	number of bytes
+ * @returns
+ *	number of bytes written
+ **/
+uint32_t ring_write(RING_STRUCT * ring, const void * data, uint32_t len)
+{
+	const uint8_t * src = data;
+	uint32_t done = 0;
+	uint8_t * span;
+	uint32_t run;
+
+	while (done < len && (run = ring_write_span(ring, &span)))
+	{
+		if (run > len - done)
+			run = len - done;
+		memcpy(span, src + done, run);
+		ring_write_commit(ring, run);
+		done += run;
+	}
+	return done;
+}
+
+/**
+ * @brief
+ *	Reads up to len bytes from a ring
+ * @param[in] ring
+ *	ring to read
+ * @param[out] data
+ *	where to copy the bytes, NULL to discard them
+ * @param[in] len
+ *	maximum number of bytes
+ * @returns
+ *	number of bytes read
+ **/
+uint32_t ring_read(RING_STRUCT * ring, void * data, uint32_t len)
+{
+	uint8_t * dst = data;
+	uint32_t done = 0;
+	uint8_t * span;
+	uint32_t run;
+
+	while (done < len && (run = ring_read_span(ring, 0, &span)))
+	{
+		if (run > len - done)
+			run = len - done;
+		if (dst)
+			memcpy(dst + done, span, run);
+		ring_read_commit(ring, run);
+		done += run;
+	}
+	return done;
+}
+
+/**
+ * @brief
+ *	TDD routine and throughput benchmark for the ring buffer
+ * @details
+ *	Checks empty / full / wrap behavior, the span accessors and staging, then times
+ *	RING_BENCH_BYTES moved through a RING_TEST_SIZE ring in 16 byte writes and reads
+ * @note
+ *	this function contains EFM_ASSERT(false) statements, it is possible to be stuck here.
+ *	Needs the DWT cycle counter, call it after scheduler_open().
+ * @returns
+ *	DWT cycles taken by the benchmark
+ **/
+uint32_t ring_test(void)
+{
+	static uint8_t test_buf[RING_TEST_SIZE];
+	RING_STRUCT ring;
+	uint8_t data[RING_TEST_SIZE + 1];
+	uint8_t out[RING_TEST_SIZE + 1];
+	uint8_t * span;
+
+	for (uint32_t i = 0; i < sizeof(data); i++)
+		data[i] = i + 1;
+
+	// TEST 1: empty ring
+	ring_init(&ring, test_buf, RING_TEST_SIZE);
+	EFM_ASSERT(ring_count(&ring) == 0 && ring_space(&ring) == RING_TEST_SIZE);
+	EFM_ASSERT(ring_read(&ring, out, 1) == 0);
+	EFM_ASSERT(ring_read_at(&ring, 0) == NULL);
+
+	// TEST 2: every byte is usable, no bubble
+	EFM_ASSERT(ring_write(&ring, data, RING_TEST_SIZE + 1) == RING_TEST_SIZE);
+	EFM_ASSERT(ring_space(&ring) == 0 && ring_write_at(&ring, 0) == NULL);
+	EFM_ASSERT(ring_read(&ring, out, RING_TEST_SIZE + 1) == RING_TEST_SIZE);
+	EFM_ASSERT(!memcmp(data, out, RING_TEST_SIZE));
+
+	// TEST 3: wrap, spans split at the end of buf
+	ring_init(&ring, test_buf, RING_TEST_SIZE);
+	ring_write(&ring, data, RING_TEST_SIZE - 4);
+	ring_read(&ring, NULL, RING_TEST_SIZE - 4);
+	EFM_ASSERT(ring_write(&ring, data, 10) == 10);
+	EFM_ASSERT(ring_read_span(&ring, 0, &span) == 4 && span[0] == data[0]);
+	EFM_ASSERT(ring_read_span(&ring, 4, &span) == 6 && span == test_buf && span[0] == data[4]);
+	EFM_ASSERT(*ring_read_at(&ring, 9) == data[9]);
+	EFM_ASSERT(ring_read(&ring, out, 10) == 10 && !memcmp(data, out, 10));
+
+	// TEST 4: staged bytes are invisible until committed, and can be taken back
+	*ring_write_at(&ring, 0) = 0xAA;
+	*ring_write_at(&ring, 1) = 0xBB;
+	EFM_ASSERT(ring_count(&ring) == 0);
+	ring_write_commit(&ring, 2);
+	EFM_ASSERT(ring_count(&ring) == 2 && *ring_read_at(&ring, 1) == 0xBB);
+	ring_unwrite(&ring, 1);
+	EFM_ASSERT(ring_read(&ring, out, 2) == 1 && out[0] == 0xAA);
+
+	// TEST 5: free running indices across the 32 bit wrap
+	ring.head = ring.tail = 0xFFFFFFF0u;
+	EFM_ASSERT(ring_write(&ring, data, 32) == 32 && ring_count(&ring) == 32);
+	EFM_ASSERT(ring_read(&ring, out, 32) == 32 && !memcmp(data, out, 32));
+
+	// BENCHMARK
+	ring_init(&ring, test_buf, RING_TEST_SIZE);
+	uint32_t start = DWT -> CYCCNT;
+	for (int i = 0; i < RING_BENCH_BYTES; i += 16)
+	{
+		ring_write(&ring, data, 16);
+		ring_read(&ring, out, 16);
+	}
+	return DWT -> CYCCNT - start;
+}
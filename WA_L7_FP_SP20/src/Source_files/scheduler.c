@@ -8,18 +8,44 @@
 #include "scheduler.h"
 #include "em_emu.h"
 #include "em_assert.h"
+#include "em_core.h"
 
-static unsigned int event_scheduled;	/**< Scheduler Integer, each bit represents a different event **/
+static volatile uint32_t event_scheduled;	/**< Scheduler Integer, each bit represents a different event **/
+static scheduler_callback_t event_handlers[SCHEDULER_EVENTS];	/**< Handler table, indexed by event bit position **/
+
+static SCHEDULER_RECORD_STRUCT event_queue[SCHEDULER_QUEUE_SIZE];	/**< Event queue, records in posting order **/
+static uint32_t queue_read;					/**< free running read index of event_queue **/
+static uint32_t queue_write;				/**< free running write index of event_queue **/
+static uint32_t queue_count[SCHEDULER_EVENTS];	/**< queued records per event, indexed by event bit position **/
+static uint32_t queue_drops;				/**< records rejected because event_queue was full **/
+
+#ifdef SCHEDULER_STATS_ENABLED
+static uint32_t event_posted[SCHEDULER_EVENTS];			/**< DWT cycle count when each event bit was last set **/
+static SCHEDULER_STATS_STRUCT event_stats[SCHEDULER_EVENTS];	/**< dispatch statistics, indexed by event bit position **/
+#endif
 
 /**
  * @brief
  *	Initializes the scheduler
  * @details
- *	Sets event_scheduled to 0 (thus clearing any event bits)
+ *	Sets event_scheduled to 0 (thus clearing any event bits), empties the event queue,
+ *	and starts the DWT cycle counter used to timestamp queued records
  **/
 void scheduler_open(void)
 {
 	event_scheduled = 0;
+	queue_read = queue_write = queue_drops = 0;
+	for (int i = 0; i < SCHEDULER_EVENTS; i++)
+	{
+		event_handlers[i] = 0;
+		queue_count[i] = 0;
+	}
+#ifdef SCHEDULER_STATS_ENABLED
+	scheduler_stats_reset();
+#endif
+
+	CoreDebug -> DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT -> CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 }
 
 /**
@@ -28,15 +54,31 @@ void scheduler_open(void)
  * @details
  *	Performs an OR operation to add event into the scheduler
  * @note
- *	Temporarily disables Interrupts, to prevent nested interrupts (keep things atomic)
+ *	Uses an LDREX / STREX loop instead of masking interrupts. An interrupt taken between
+ *	the two clears the exclusive monitor, the STREX fails, and the OR is retried. Safe to
+ *	call from any IRQ handler, and never changes PRIMASK.
+ *	With SCHEDULER_STATS_ENABLED, bits that were clear are timestamped for the
+ *	queueing delay statistics; re-adding a pending event keeps its first timestamp.
+ *	The time is read before the loop and stored between the LDREX and the STREX, so the
+ *	timestamp is in place before the bit can be seen. A nested post that sets the bit
+ *	first makes the STREX fail, and the retry leaves that bit's timestamp alone.
  * @param[in] event
  *	The event to be set
  **/
 void add_scheduled_event(uint32_t event)
 {
-	__disable_irq();
-	event_scheduled |= event;
-	__enable_irq();
+	uint32_t events;
+#ifdef SCHEDULER_STATS_ENABLED
+	uint32_t now = DWT -> CYCCNT;
+#endif
+	do
+	{
+		events = __LDREXW(&event_scheduled);
+#ifdef SCHEDULER_STATS_ENABLED
+		for (uint32_t posted = event & ~events; posted; posted &= posted - 1)
+			event_posted[__CLZ(__RBIT(posted))] = now;
+#endif
+	} while (__STREXW(events | event, &event_scheduled));
 }
 
 /**
@@ -45,15 +87,42 @@ void add_scheduled_event(uint32_t event)
  * @details
  *	Performs a negated AND operation to remove event from the scheduler
  * @note
- *	Temporarily disables Interrupts, to prevent nested interrupts (keep things atomic)
+ *	Uses an LDREX / STREX loop, see add_scheduled_event()
  * @param[in] event
- *	The event to be set
+ *	The event to be cleared
  **/
 void remove_scheduled_event(uint32_t event)
 {
-	__disable_irq();
-	event_scheduled &= ~event;
-	__enable_irq();
+	uint32_t events;
+	do
+	{
+		events = __LDREXW(&event_scheduled) & ~event;
+	} while (__STREXW(events, &event_scheduled));
+}
+
+/**
+ * @brief
+ *	Atomically fetches and clears the highest priority pending event
+ * @details
+ *	Finds the highest set bit with __CLZ and clears it in the same LDREX / STREX pair
+ *	that read it, so an event posted by an IRQ in between is never lost or cleared
+ * @returns
+ *	the fetched event (single bit), or 0 if no events were pending
+ **/
+uint32_t fetch_scheduled_event(void)
+{
+	uint32_t events, event;
+	do
+	{
+		events = __LDREXW(&event_scheduled);
+		if (!events)
+		{
+			__CLREX();
+			return 0;
+		}
+		event = 0x80000000u >> __CLZ(events);
+	} while (__STREXW(events & ~event, &event_scheduled));
+	return event;
 }
 
 /**
@@ -69,3 +138,226 @@ uint32_t get_scheduled_events(void)
 {
 	return event_scheduled;
 }
+
+/**
+ * @brief
+ *	Posts an event with a payload into the event queue
+ * @details
+ *	Appends a timestamped record to event_queue and sets the event's bit, so its handler
+ *	is dispatched as usual. Unlike the bare flag, repeated posts are not coalesced: the
+ *	handler drains every record with pop_scheduled_event().
+ * @note
+ *	Safe to call from IRQ handlers, never allocates. The critical section saves and
+ *	restores PRIMASK.
+ * @param[in] event
+ *	The event (single bit) to be posted
+ * @param[in] payload
+ *	Data carried by the record, either a small value or a pointer
+ * @returns
+ *	true if the record was queued, false if the queue was full (counted in queue_drops)
+ **/
+bool post_scheduled_event(uint32_t event, uint32_t payload)
+{
+	bool queued = false;
+	CORE_DECLARE_IRQ_STATE;
+
+	EFM_ASSERT(event && !(event & (event - 1)));
+
+	CORE_ENTER_CRITICAL();
+	if (queue_write - queue_read < SCHEDULER_QUEUE_SIZE)
+	{
+		SCHEDULER_RECORD_STRUCT * record = &event_queue[queue_write & (SCHEDULER_QUEUE_SIZE - 1)];
+		record -> event = event;
+		record -> timestamp = DWT -> CYCCNT;
+		record -> payload = payload;
+		queue_write++;
+		queue_count[31 - __CLZ(event)]++;
+		queued = true;
+	}
+	else
+		queue_drops++;
+	CORE_EXIT_CRITICAL();
+
+	add_scheduled_event(event);
+	return queued;
+}
+
+/**
+ * @brief
+ *	Pops the oldest queued record for an event
+ * @details
+ *	Searches event_queue from the oldest record, copies the first match out, and closes
+ *	the gap by sliding the older records of other events up by one
+ * @note
+ *	Intended for the main loop, called by an event's handler until it returns false.
+ *	The search is bounded by SCHEDULER_QUEUE_SIZE.
+ * @param[in] event
+ *	The event (single bit) to pop a record for
+ * @param[out] record
+ *	Where the popped record is copied to
+ * @returns
+ *	true if a record was popped, false if none were queued for event
+ **/
+bool pop_scheduled_event(uint32_t event, SCHEDULER_RECORD_STRUCT * record)
+{
+	bool found = false;
+	CORE_DECLARE_IRQ_STATE;
+
+	CORE_ENTER_CRITICAL();
+	for (uint32_t i = queue_read; i != queue_write; i++)
+	{
+		if (event_queue[i & (SCHEDULER_QUEUE_SIZE - 1)].event == event)
+		{
+			*record = event_queue[i & (SCHEDULER_QUEUE_SIZE - 1)];
+			for (; i != queue_read; i--)
+				event_queue[i & (SCHEDULER_QUEUE_SIZE - 1)] = event_queue[(i - 1) & (SCHEDULER_QUEUE_SIZE - 1)];
+			queue_read++;
+			queue_count[31 - __CLZ(event)]--;
+			found = true;
+			break;
+		}
+	}
+	CORE_EXIT_CRITICAL();
+
+	return found;
+}
+
+/**
+ * @brief
+ *	Returns the number of queued records for an event
+ * @param[in] event
+ *	The event (single bit) to count
+ * @returns
+ *	records waiting in the event queue for event
+ **/
+uint32_t get_scheduled_count(uint32_t event)
+{
+	EFM_ASSERT(event);
+	return queue_count[31 - __CLZ(event)];
+}
+
+/**
+ * @brief
+ *	Returns the number of records dropped because the event queue was full
+ * @returns
+ *	queue_drops, the overflow counter of the event queue
+ **/
+uint32_t get_scheduler_queue_drops(void)
+{
+	return queue_drops;
+}
+
+/**
+ * @brief
+ *	Registers the handler for a scheduled event
+ * @details
+ *	Stores callback in the handler table, at the slot of the event's bit position
+ * @note
+ *	The bit position is also the event's priority: when several events are pending,
+ *	scheduler_dispatch() services the highest set bit first (BOOT_UP_EVT is bit 31).
+ *	event must have exactly one bit set.
+ * @param[in] event
+ *	The event (single bit) to be handled
+ * @param[in] callback
+ *	The function called from the main loop when the event is dispatched
+ **/
+void scheduler_register_event(uint32_t event, scheduler_callback_t callback)
+{
+	EFM_ASSERT(event && !(event & (event - 1)));
+	event_handlers[31 - __CLZ(event)] = callback;
+}
+
+#ifdef SCHEDULER_STATS_ENABLED
+/**
+ * @brief
+ *	Adds one sample to a timing record
+ * @details
+ *	Updates min / max / sum, and counts the sample in the log2 bucket of its highest set
+ *	bit, found with a single __CLZ
+ * @param[in] timing
+ *	timing record to update
+ * @param[in] cycles
+ *	sample, in DWT cycles
+ **/
+static void scheduler_stats_record(SCHEDULER_TIMING_STRUCT * timing, uint32_t cycles)
+{
+	uint32_t bucket = 31 - __CLZ(cycles | 1);
+	if (bucket >= SCHEDULER_STATS_BUCKETS)
+		bucket = SCHEDULER_STATS_BUCKETS - 1;
+
+	timing -> count++;
+	timing -> sum += cycles;
+	if (cycles < timing -> min)
+		timing -> min = cycles;
+	if (cycles > timing -> max)
+		timing -> max = cycles;
+	if (timing -> hist[bucket] != UINT16_MAX)
+		timing -> hist[bucket]++;
+}
+#endif
+
+/**
+ * @brief
+ *	Dispatches the highest priority pending event
+ * @details
+ *	Fetches and clears the highest set bit with fetch_scheduled_event(), then calls
+ *	the registered handler
+ * @note
+ *	Handlers do not need to call remove_scheduled_event(), the bit is already cleared
+ *	when they run. An event with no registered handler is dropped and asserts.
+ * @returns
+ *	true if an event was dispatched, false if none were pending
+ **/
+bool scheduler_dispatch(void)
+{
+	uint32_t event = fetch_scheduled_event();
+	if (!event)
+		return false;
+
+	uint32_t bit = 31 - __CLZ(event);
+	EFM_ASSERT(event_handlers[bit]);
+	if (!event_handlers[bit])
+		return true;
+
+#ifdef SCHEDULER_STATS_ENABLED
+	uint32_t start = DWT -> CYCCNT;
+	scheduler_stats_record(&event_stats[bit].delay, start - event_posted[bit]);
+	event_handlers[bit]();
+	scheduler_stats_record(&event_stats[bit].runtime, DWT -> CYCCNT - start);
+#else
+	event_handlers[bit]();
+#endif
+	return true;
+}
+
+#ifdef SCHEDULER_STATS_ENABLED
+/**
+ * @brief
+ *	Returns the dispatch statistics of an event
+ * @note
+ *	The cycle counter only runs in EM0, so queueing delay does not include time spent
+ *	asleep. That is intended: an event is only ever posted from an IRQ that woke the core.
+ * @param[in] event
+ *	The event (single bit) to report
+ * @returns
+ *	pointer to the event's statistics, valid until the next scheduler_stats_reset()
+ **/
+const SCHEDULER_STATS_STRUCT * get_scheduler_stats(uint32_t event)
+{
+	EFM_ASSERT(event && !(event & (event - 1)));
+	return &event_stats[31 - __CLZ(event)];
+}
+
+/**
+ * @brief
+ *	Clears the dispatch statistics of every event
+ **/
+void scheduler_stats_reset(void)
+{
+	for (int i = 0; i < SCHEDULER_EVENTS; i++)
+	{
+		event_stats[i].delay = (SCHEDULER_TIMING_STRUCT){ .min = UINT32_MAX };
+		event_stats[i].runtime = (SCHEDULER_TIMING_STRUCT){ .min = UINT32_MAX };
+	}
+}
+#endif
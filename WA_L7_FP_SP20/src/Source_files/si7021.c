@@ -7,19 +7,33 @@
 #include "si7021.h"
 #include "gpio.h"
 #include "app.h"
+#include "soft_timer.h"
 #include <stdbool.h>
 
-static uint16_t rx_buffer;				/**< Si7021's receiving buffer, holds a single raw temperature reading **/
-static I2C_PAYLOAD_STRUCT i2c_pl_s;		/**< Si7021's I2C payload struct, to be passed and used by I2C **/
+static const uint8_t si7021_cmd = SI7021_TEMP_NO_HOLD;	/**< Si7021's measure command **/
+static uint8_t rx_buffer[2];			/**< Si7021's receiving buffer, holds a single raw temperature reading, MSB first **/
+static I2C_PAYLOAD_STRUCT i2c_cmd_s;	/**< Si7021's I2C payload struct for the measure command **/
+static I2C_PAYLOAD_STRUCT i2c_pl_s;		/**< Si7021's I2C payload struct for reading the result **/
+static uint32_t si7021_timer;			/**< soft timer id for the conversion wait **/
+static uint32_t si7021_read_evt;		/**< scheduled event id for the end of the conversion wait **/
+static bool si7021_converting;			/**< measure command queued, the result is not read yet **/
 
 /**
  * @brief
  *	Opener function for I2C, to configure it for Si7021
  * @details
  *	creates instances of I2C_IO_STRUCT and I2C_OPEN_STRUCT and passes them to i2c_open()
+ * @param[in] timer
+ *	soft timer id for the conversion wait
+ * @param[in] read_event
+ *	scheduler event ID posted once the conversion is done, its handler calls si7021_read()
  **/
-void si7021_i2c_open()
+void si7021_i2c_open(uint32_t timer, uint32_t read_event)
 {
+	si7021_timer = timer;
+	si7021_read_evt = read_event;
+	si7021_converting = false;
+
 	I2C_IO_STRUCT i2c_io_s;
 	i2c_io_s.SCL_PORT = SI7021_SCL_PORT;
 	i2c_io_s.SCL_PIN  = SI7021_SCL_PIN;
@@ -44,21 +58,73 @@ void si7021_i2c_open()
  * @brief
  * 	Start function for I2C, to use it for the Si7021
  * @details
- * 	configures the static I2C_PAYLOAD_STRUCT, and passes it to i2c_start()
+ * 	writes the measure command (no hold master mode), which releases the bus, and waits
+ * 	SI7021_CONV_MS on a soft timer instead of polling the Si7021 with reads it NACKs.
+ * 	The timer's event handler calls si7021_read(), so the core sleeps in EM2 or below
+ * 	for the whole conversion.
+ * @note
+ * 	si7021_i2c_open() must be called before using this function.
+ * 	The wait is one tick longer than the conversion: the timer may start late in a tick.
+ * @returns
+ * 	false if the previous reading is still in progress, this one is skipped
+ **/
+bool si7021_i2c_start()
+{
+	if (si7021_busy())
+		return false;
+	i2c_cmd_s.dev_addr = SI7021_DEV_ADDR;
+	i2c_cmd_s.tx_buf = &si7021_cmd;
+	i2c_cmd_s.tx_len = sizeof(si7021_cmd);
+	i2c_cmd_s.rx_len = 0;
+	i2c_cmd_s.nack_retry = false;
+	i2c_cmd_s.dev_evt = 0;
+
+	if (!i2c_start(SI7021_I2C, &i2c_cmd_s))
+		return false;
+	si7021_converting = true;
+	soft_timer_start(si7021_timer, SOFT_TIMER_MS(SI7021_CONV_MS) + 1, 0, si7021_read_evt);
+	return true;
+}
+
+/**
+ * @brief
+ * 	Reads the result of the conversion started by si7021_i2c_start()
+ * @details
+ * 	a single two byte read, the result comes back as I2C_SI7021_EVT. The read is still
+ * 	retried if the Si7021 NACKs it, in case the measure command waited for the bus.
+ * 	If the bus queue is full the timer is re-armed for SI7021_RETRY_MS, and the read
+ * 	is tried again from the same event.
  * @note
- * 	si7021_i2c_open() must be called before using this function
+ * 	called from the handler of the event given to si7021_i2c_open()
  **/
-void si7021_i2c_start()
+void si7021_read(void)
 {
+	if (!si7021_converting)
+		return;
 	i2c_pl_s.dev_addr = SI7021_DEV_ADDR;
-	i2c_pl_s.dev_buffer = &rx_buffer;
-	i2c_pl_s.dev_cmd = SI7021_TEMP_NO_HOLD;
+	i2c_pl_s.tx_len = 0;
+	i2c_pl_s.rx_buf = rx_buffer;
+	i2c_pl_s.rx_len = sizeof(rx_buffer);
+	i2c_pl_s.nack_retry = true;
 	i2c_pl_s.dev_evt = I2C_SI7021_EVT;
-	i2c_pl_s.i2c = SI7021_I2C;
-	i2c_pl_s.i2c_state = I2C_STATE_IDLE;
-	i2c_pl_s.read = true;
 
-	i2c_start(SI7021_I2C, &i2c_pl_s);
+	if (!i2c_start(SI7021_I2C, &i2c_pl_s))
+	{
+		soft_timer_start(si7021_timer, SOFT_TIMER_MS(SI7021_RETRY_MS), 0, si7021_read_evt);
+		return;
+	}
+	si7021_converting = false;
+}
+
+/**
+ * @brief
+ * 	Checks if a reading is in progress
+ * @returns
+ * 	true from si7021_i2c_start() until the result is read off the bus
+ **/
+bool si7021_busy(void)
+{
+	return si7021_converting || i2c_cmd_s.i2c_state != I2C_STATE_IDLE || i2c_pl_s.i2c_state != I2C_STATE_IDLE;
 }
 
 void si7021_lpm_enable()
@@ -87,41 +153,90 @@ void si7021_lpm_disable()
 }
 /**
  * @brief
- *	Getter for the Si7021's temperature reading, in Kelvin
+ *	Converts a Si7021 temperature reading, once
  * @details
- *	converts the raw rx_data to Kelvin
+ *	Temp = 175.72 * raw / 65536 - 46.85 (datasheet), in integer hundredths of a degree
+ *	Celsius and rounded to nearest: 17572 * 65535 still fits in 32 bits
+ * @param[in] raw
+ *	raw temperature reading from the Si7021
+ * @param[out] sample
+ *	converted reading, the other units are derived from it
+ **/
+void si7021_sample(uint16_t raw, SI7021_SAMPLE_STRUCT * sample)
+{
+	sample -> raw = raw;
+	sample -> centi_c = (int32_t)((17572u * raw + 0x8000) >> 16) - 4685;
+}
+
+/**
+ * @brief
+ *	Converts a Si7021 sample to Kelvin
+ * @param[in] sample
+ *	sample from si7021_sample()
  * @returns
- *	temperature in Kelvin, to the tenth of a degree
+ *	temperature in hundredths of a Kelvin
  **/
-float si7021_temp_K()
+int32_t si7021_centi_K(const SI7021_SAMPLE_STRUCT * sample)
 {
-	float tempK = (175.72 * (float)rx_buffer / 65536) + 226.3;
-	return (float)((int)(tempK*10))/10;
+	return sample -> centi_c + 27315;
 }
+
 /**
  * @brief
- *	Getter for the Si7021's temperature reading, in Fahrenheit
- * @details
- *	converts the raw rx_data to Fahrenheit
+ *	Converts a Si7021 sample to Fahrenheit
+ * @param[in] sample
+ *	sample from si7021_sample()
  * @returns
- *	temperature in Fahrenheit, to the tenth of a degree
+ *	temperature in hundredths of a degree Fahrenheit, rounded to nearest
  **/
-float si7021_temp_F()
+int32_t si7021_centi_F(const SI7021_SAMPLE_STRUCT * sample)
 {
-	float tempF = (316.296 * (float)rx_buffer / 65536) - 52.33;
-	return (float)((int)(tempF*10))/10;
+	int32_t c9 = sample -> centi_c * 9;
+	return (c9 + ((c9 < 0) ? -2 : 2)) / 5 + 3200;
 }
 
 /**
  * @brief
- *	Getter for the Si7021's temperature reading, in Celsius
+ *	Converts a Si7021 sample to Celsius
+ * @param[in] sample
+ *	sample from si7021_sample()
+ * @returns
+ *	temperature in hundredths of a degree Celsius
+ **/
+int32_t si7021_centi_C(const SI7021_SAMPLE_STRUCT * sample)
+{
+	return sample -> centi_c;
+}
+
+/**
+ * @brief
+ *	Finds the raw reading a temperature threshold starts at
  * @details
- *	converts the raw rx_data to Celsius
+ *	Binary search over the raw range through the same conversion the readings use, so
+ *	raw >= the result exactly when unit(sample) >= centi, with a single compare per
+ *	sample and no conversion
+ * @note
+ *	Called when the threshold is configured, not per sample
+ * @param[in] centi
+ *	threshold in hundredths of a degree
+ * @param[in] unit
+ *	unit of centi, si7021_centi_K, si7021_centi_F or si7021_centi_C
  * @returns
- *	temperature in Celsius, to the tenth of a degree
+ *	lowest raw reading at or above the threshold, SI7021_NEVER if there is none
  **/
-float si7021_temp_C()
+uint32_t si7021_raw_threshold(int32_t centi, si7021_unit_t unit)
 {
-	float tempC = (175.72 * (float)rx_buffer / 65536) - 46.85;
-	return (float)((int)(tempC*10))/10;
+	SI7021_SAMPLE_STRUCT sample;
+	uint32_t low = 0, high = SI7021_NEVER;
+
+	while (low < high)
+	{
+		uint32_t mid = (low + high) / 2;
+		si7021_sample(mid, &sample);
+		if (unit(&sample) >= centi)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return low;
 }
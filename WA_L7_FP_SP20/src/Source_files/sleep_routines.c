@@ -28,100 +28,334 @@
 **/
 
 #include "sleep_routines.h"
+#include "scheduler.h"
+#include "soft_timer.h"
 #include <stdbool.h>
 
-static int lowest_energy_mode[MAX_ENERGY_MODES]; /**< array tracking blocks to sleep modes EM0 - EM4 **/
+static uint32_t block_owners[MAX_ENERGY_MODES];	/**< per energy mode, bit n set while owner n blocks it **/
+static uint32_t blocked_modes;						/**< bit (31 - em) set while em has any owner, so __CLZ gives the lowest **/
+static const char * const owner_names[SLEEP_OWNER_COUNT] =
+	{ "LETIMER0", "I2C0", "I2C1", "LEUART0TX", "LEUART0RX", "SOFTTIMER" };	/**< owner names, for diagnostics **/
+
+static uint32_t residency_start;					/**< RTCC tick the residency totals were last reset at **/
+static uint32_t residency_ticks[MAX_ENERGY_MODES];	/**< RTCC ticks spent in each sleep mode, EM0 is derived **/
+static uint32_t wakeup_count[SLEEP_IRQ_COUNT];		/**< wake-ups per IRQ, indexed by IRQn **/
+
+/**
+ * @brief
+ *	Counts the interrupts that ended a sleep
+ * @details
+ *	Called right after the core wakes, while PRIMASK is still set, so the waking IRQs
+ *	are still pending in the NVIC and have not been serviced yet
+ * @note
+ *	Interrupts that became pending together are all counted
+ **/
+static void sleep_count_wakeups(void)
+{
+	for (uint32_t word = 0; word < (SLEEP_IRQ_COUNT + 31) / 32; word++)
+	{
+		uint32_t pending = NVIC -> ISPR[word] & NVIC -> ISER[word];
+		while (pending)
+		{
+			uint32_t bit = 31 - __CLZ(pending);
+			pending &= ~(1u << bit);
+			if (word * 32 + bit < SLEEP_IRQ_COUNT)
+				wakeup_count[word * 32 + bit]++;
+		}
+	}
+}
+
+/**
+ * @brief
+ *	Limits the sleep mode by the time left until the next soft timer deadline
+ * @details
+ *	Programs the RTCC compare for the nearest deadline (soft_timer_arm()). A deadline in
+ *	the current tick is due now, one in the next tick may be any part of a tick away and
+ *	only allows EM1, anything later allows em.
+ * @note
+ *	The EM2 / EM3 wake-up times (tens of us on the PG12, and the same for both) are far
+ *	below the 1 ms RTCC tick, so they are not weighed against the time left: only a
+ *	deadline less than a tick away is close enough to matter.
+ * @param[in] em
+ *	the deepest energy mode allowed by the sleep blocks
+ * @returns
+ *	the energy mode to enter, EM0 if the deadline is already due
+ **/
+static uint32_t sleep_deadline_mode(uint32_t em)
+{
+	uint32_t ticks;
+
+	soft_timer_arm();
+	if (!soft_timer_next_deadline(&ticks))
+		return em;
+	if (!ticks)
+		return EM0;
+	return (ticks == 1) ? EM1 : em;
+}
 
 /**
  * @brief
  *	Initializes the Sleep Manager
  * @details
- *	Zeroes private array lowest_energy_mode
+ *	Clears every owner's blocks, and the residency / wake-up totals
  * @note
- *	Will overwrite any existing blocks, this should only be called once
+ *	Will overwrite any existing blocks, this should only be called once.
+ *	Runs before soft_timer_open(), so the RTCC is not read here. The RTCC keeps counting
+ *	through EM4H, so its counter is not where residency starts: call sleep_stats_reset()
+ *	once soft_timer_open() has run.
  **/
 void sleep_open(void)
 {
 	for (int i = 0; i < MAX_ENERGY_MODES; i++)
-		lowest_energy_mode[i] = 0;
+	{
+		block_owners[i] = 0;
+		residency_ticks[i] = 0;
+	}
+	blocked_modes = 0;
+	for (int i = 0; i < SLEEP_IRQ_COUNT; i++)
+		wakeup_count[i] = 0;
+	residency_start = 0;
 }
 /**
  * @brief
- *	Adds sleep block at specified energy mode
+ *	Adds owner's sleep block at specified energy mode
  * @details
- *	Increments lowest_energy_mode[em]
+ *	Sets owner's bit in block_owners[em], and marks em as blocked
  * @note
- *	This function does not check the input energy mode, so it is possible to access
- *	an out of bounds value in the array. Be sure to use the predefined constants from
- *	sleep_routines.h (EM0, EM1, EM2, EM3, EM4)
+ *	Saves and restores PRIMASK rather than unconditionally re-enabling interrupts, so it
+ *	is safe to call from IRQ handlers that have interrupts masked.
+ *	An owner blocking a mode it already blocks asserts, that is a leaked block.
+ * @param[in] owner
+ *	The driver taking the block
  * @param[in] em
- *	The energy mode to be blocked
+ *	The energy mode to be blocked, EM0 - EM4
  **/
-void sleep_block_mode(uint32_t em)
+void sleep_block_mode(sleep_owner_t owner, uint32_t em)
 {
-	__disable_irq();
+	EFM_ASSERT(owner < SLEEP_OWNER_COUNT && em < MAX_ENERGY_MODES);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
 
-	lowest_energy_mode[em]++;
-	EFM_ASSERT(lowest_energy_mode[em] < 10);
+	EFM_ASSERT(!(block_owners[em] & (1u << owner)));
+	block_owners[em] |= 1u << owner;
+	blocked_modes |= 0x80000000u >> em;
 
-	__enable_irq();
+	CORE_EXIT_CRITICAL();
 }
 /**
  * @brief
- *	Removes sleep block at specified energy mode
+ *	Removes owner's sleep block at specified energy mode
  * @details
- *	Decrements lowest_energy_mode[em]
+ *	Clears owner's bit in block_owners[em], and unmarks em once it has no owners left
  * @note
- *	This function does not check the input energy mode, so it is possible to access
- *	an out of bounds value in the array. Be sure to use the predefined constants from
- *	sleep_routines.h (EM0, EM1, EM2, EM3, EM4).
- *	If unblock is called on an energy mode that is not blocked, you will end up in an
+ *	Saves and restores PRIMASK, see sleep_block_mode().
+ *	If an owner unblocks an energy mode it does not block, you will end up in an
  *	EFM_ASSERT(), be sure to watch where you block and unblock sleep.
+ * @param[in] owner
+ *	The driver releasing the block
  * @param[in] em
- *	The energy mode to be unblocked
+ *	The energy mode to be unblocked, EM0 - EM4
  **/
-void sleep_unblock_mode(uint32_t em)
+void sleep_unblock_mode(sleep_owner_t owner, uint32_t em)
 {
-	__disable_irq();
+	EFM_ASSERT(owner < SLEEP_OWNER_COUNT && em < MAX_ENERGY_MODES);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
 
-	lowest_energy_mode[em]--;
-	EFM_ASSERT(lowest_energy_mode[em] >= 0);
+	EFM_ASSERT(block_owners[em] & (1u << owner));
+	block_owners[em] &= ~(1u << owner);
+	if (!block_owners[em])
+		blocked_modes &= ~(0x80000000u >> em);
 
-	__enable_irq();
+	CORE_EXIT_CRITICAL();
 }
 /**
  * @brief
  *	Puts the Pearl Gecko in the lowest available sleep mode, if possible
  * @details
- *	Based on the lowest_energy_mode blocks array, checks for blocks and then picks to sleep or not
+ *	Picks the mode one shallower than the lowest blocked one (current_block_energy_mode(),
+ *	EM3 when nothing is blocked),
+ *	then limits it by the next soft timer deadline (see sleep_deadline_mode()).
+ *	The RTCC is read on the way in and out, the difference is added to the residency
+ *	of the mode entered, and the interrupts that woke the core are counted.
  * @note
- *	EM4 is not enabled in this implementation, as the CPU context state is lost
+ *	EM4 is not enabled in this implementation, as the CPU context state is lost.
+ *	The RTCC ticks at 1 ms, a single short sleep may read as 0 or 1 ticks, but the
+ *	totals average out over many sleeps.
  **/
 void enter_sleep(void)
 {
-	if (lowest_energy_mode[EM0] > 0 || lowest_energy_mode[EM1] > 0)
+	uint32_t em, start;
+
+	em = current_block_energy_mode();
+	if (em <= EM1)
 		return;
-	else if (lowest_energy_mode[EM2] > 0)
-		EMU_EnterEM1();
-	else if (lowest_energy_mode[EM3] > 0)
-		EMU_EnterEM2(true);
-	else
-		EMU_EnterEM3(true);
+	em--;
+
+	em = sleep_deadline_mode(em);
+	start = soft_timer_now();
+	switch (em)
+	{
+		case EM1:
+			EMU_EnterEM1();
+			break;
+		case EM2:
+			EMU_EnterEM2(true);
+			break;
+		case EM3:
+			EMU_EnterEM3(true);
+			break;
+		default:
+			return;
+	}
+	residency_ticks[em] += soft_timer_now() - start;
+	sleep_count_wakeups();
+}
+/**
+ * @brief
+ *	Idles the Pearl Gecko until there is a scheduled event to service
+ * @details
+ *	Masks interrupts, re-checks the scheduler, and only calls enter_sleep() if no event
+ *	is pending. The WFI inside enter_sleep() executes with PRIMASK set: a pending
+ *	interrupt still wakes the core, and its handler runs once interrupts are unmasked
+ *	on the way out of this function.
+ * @note
+ *	Replaces the separate get_scheduled_events() / enter_sleep() calls in the main loop,
+ *	where an event posted between the two would not be serviced until the next interrupt.
+ *	The RTCC compare is reprogrammed first, on every pass, so soft timers started or
+ *	stopped by the last handler take effect even if the core does not sleep (events
+ *	still pending, or EM2 blocked).
+ **/
+void sleep_idle(void)
+{
+	soft_timer_arm();
+	__disable_irq();
+	if (!get_scheduled_events())
+		enter_sleep();
+	__enable_irq();
 }
 /**
  * @brief
  *	Returns the current lowest accessible energy mode
  * @details
- *	Iterates through lowest_energy_mode, looking for blocks
+ *	A single __CLZ of blocked_modes, which holds the blocked modes in reverse bit order
  * @note
  *	It is possible for EM4 to be returned from this, even though it is not accessible at this time
  * @returns
- * 	lowest accessible energy mode, EM0 - EM4
+ * 	lowest blocked energy mode, EM0 - EM4, or EM4 if nothing is blocked
  **/
 uint32_t current_block_energy_mode(void)
 {
+	uint32_t em = __CLZ(blocked_modes);
+	return (em < MAX_ENERGY_MODES) ? em : MAX_ENERGY_MODES - 1;
+}
+/**
+ * @brief
+ *	Returns the owners blocking an energy mode
+ * @param[in] em
+ *	energy mode, EM0 - EM4
+ * @returns
+ *	bitmask with bit n set while sleep_owner_t n blocks em
+ **/
+uint32_t sleep_block_owners(uint32_t em)
+{
+	EFM_ASSERT(em < MAX_ENERGY_MODES);
+	return block_owners[em];
+}
+/**
+ * @brief
+ *	Returns the name of a sleep block owner
+ * @param[in] owner
+ *	sleep block owner
+ * @returns
+ *	owner's name, for diagnostics
+ **/
+const char * sleep_owner_name(sleep_owner_t owner)
+{
+	EFM_ASSERT(owner < SLEEP_OWNER_COUNT);
+	return owner_names[owner];
+}
+/**
+ * @brief
+ *	Returns the time spent in an energy mode
+ * @details
+ *	EM1 - EM3 are accumulated by enter_sleep(), EM4 by sleep_residency_restore() after
+ *	each hibernation, EM0 is the rest of the time since sleep_stats_reset()
+ * @note
+ *	Totals are 32 bit RTCC ticks (SOFT_TIMER_HZ), and wrap after ~49 days without a reset
+ * @param[in] em
+ *	energy mode, EM0 - EM4
+ * @returns
+ *	RTCC ticks spent in em
+ **/
+uint32_t sleep_residency_ticks(uint32_t em)
+{
+	EFM_ASSERT(em < MAX_ENERGY_MODES);
+	if (em != EM0)
+		return residency_ticks[em];
+
+	uint32_t ticks = soft_timer_now() - residency_start;
+	for (int i = EM1; i < MAX_ENERGY_MODES; i++)
+		ticks -= residency_ticks[i];
+	return ticks;
+}
+/**
+ * @brief
+ *	Returns the number of sleeps ended by an interrupt
+ * @param[in] irq
+ *	IRQn of the interrupt, 0 to SLEEP_IRQ_COUNT - 1
+ * @returns
+ *	wake-ups counted for irq since sleep_stats_reset()
+ **/
+uint32_t sleep_wakeup_count(uint32_t irq)
+{
+	EFM_ASSERT(irq < SLEEP_IRQ_COUNT);
+	return wakeup_count[irq];
+}
+/**
+ * @brief
+ *	Carries the residency totals on after a wake-up from EM4H
+ * @details
+ *	The totals saved before hibernating are restored, hibernated is added to EM4, and
+ *	the start of the totals is moved back so sleep_residency_ticks(EM0) carries on from
+ *	the saved EM0 total
+ * @param[in] ticks
+ *	sleep_residency_ticks() of EM0 - EM4, read just before hibernating
+ * @param[in] hibernated
+ *	RTCC ticks from hibernating to this call
+ **/
+void sleep_residency_restore(const uint32_t * ticks, uint32_t hibernated)
+{
+	uint32_t total = hibernated;
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+
+	for (int i = EM0; i < MAX_ENERGY_MODES; i++)
+	{
+		if (i != EM0)
+			residency_ticks[i] = ticks[i];
+		total += ticks[i];
+	}
+	residency_ticks[EM4] += hibernated;
+	residency_start = soft_timer_now() - total;
+
+	CORE_EXIT_CRITICAL();
+}
+/**
+ * @brief
+ *	Clears the residency and wake-up totals
+ **/
+void sleep_stats_reset(void)
+{
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+
+	residency_start = soft_timer_now();
 	for (int i = 0; i < MAX_ENERGY_MODES; i++)
-		if (lowest_energy_mode[i])
-			return i;
-	return MAX_ENERGY_MODES - 1;
+		residency_ticks[i] = 0;
+	for (int i = 0; i < SLEEP_IRQ_COUNT; i++)
+		wakeup_count[i] = 0;
+
+	CORE_EXIT_CRITICAL();
 }
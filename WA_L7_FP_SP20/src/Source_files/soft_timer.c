@@ -0,0 +1,321 @@
+/**
+ * @file soft_timer.c
+ * @author William Abrams
+ * @date October 16th, 2026
+ * @brief One-shot and periodic software timers, multiplexed onto a single RTCC compare
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Silicon Lab include files
+#include "em_cmu.h"
+#include "em_core.h"
+#include "em_assert.h"
+
+//** User/developer include files
+#include "soft_timer.h"
+#include "scheduler.h"
+#include "sleep_routines.h"
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+/**
+ * @brief
+ *  Soft Timer State
+ */
+typedef struct {
+	bool		active;			/**< timer is counting down to deadline **/
+	uint32_t	deadline;		/**< absolute RTCC tick the timer expires at **/
+	uint32_t	period;			/**< reload in ticks for periodic timers, 0 for one-shot **/
+	uint32_t	event;			/**< scheduler event id posted on expiry **/
+} SOFT_TIMER_STRUCT;
+
+static SOFT_TIMER_STRUCT soft_timers[SOFT_TIMER_COUNT];	/**< soft timer table, indexed by timer id **/
+static bool soft_timer_blocked;							/**< true while SOFT_TIMER_EM is blocked **/
+static bool soft_timer_dirty;							/**< timer table changed since the compare was programmed **/
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/**
+ * @brief
+ *	Checks if a deadline has been reached
+ * @details
+ *	Compares through a signed difference, so it stays correct across counter wrap
+ * @param[in] deadline
+ *	absolute RTCC tick
+ * @param[in] now
+ *	current RTCC tick
+ **/
+static inline bool soft_timer_expired(uint32_t deadline, uint32_t now)
+{
+	return (int32_t)(deadline - now) <= 0;
+}
+
+/**
+ * @brief
+ *	Finds the nearest active deadline
+ * @param[out] deadline
+ *	the nearest absolute RTCC tick, only written if a timer is active
+ * @returns
+ *	true if any soft timer is active
+ **/
+static bool soft_timer_nearest(uint32_t * deadline)
+{
+	bool any = false;
+
+	for (int i = 0; i < SOFT_TIMER_COUNT; i++)
+	{
+		if (soft_timers[i].active && (!any || (int32_t)(soft_timers[i].deadline - *deadline) < 0))
+		{
+			*deadline = soft_timers[i].deadline;
+			any = true;
+		}
+	}
+	return any;
+}
+
+/**
+ * @brief
+ *	Programs the RTCC compare to the nearest active deadline
+ * @details
+ *	Writes the nearest deadline to SOFT_TIMER_CC, and blocks / unblocks SOFT_TIMER_EM
+ *	depending on whether any timer is running
+ * @note
+ *	The counter is read back after the compare is written: if the deadline has already
+ *	passed the match would be missed, so the interrupt is raised in software instead.
+ *	Must be called with interrupts masked.
+ **/
+static void soft_timer_program(void)
+{
+	uint32_t nearest;
+
+	soft_timer_dirty = false;
+	if (!soft_timer_nearest(&nearest))
+	{
+		RTCC_IntDisable(SOFT_TIMER_IF);
+		if (soft_timer_blocked)
+			sleep_unblock_mode(SLEEP_OWNER_SOFT_TIMER, SOFT_TIMER_EM);
+		soft_timer_blocked = false;
+		return;
+	}
+
+	if (!soft_timer_blocked)
+		sleep_block_mode(SLEEP_OWNER_SOFT_TIMER, SOFT_TIMER_EM);
+	soft_timer_blocked = true;
+
+	RTCC_ChannelCCVSet(SOFT_TIMER_CC, nearest);
+	RTCC_IntEnable(SOFT_TIMER_IF);
+	if (soft_timer_expired(nearest, RTCC_CounterGet()))
+		RTCC_IntSet(SOFT_TIMER_IF);
+}
+
+/**
+ * @brief
+ *	Opens the soft timer service
+ * @details
+ *	Enables the RTCC as a free running 1 kHz counter on the LFE branch (ULFRCO, see
+ *	cmu_open()), and configures SOFT_TIMER_CC as a compare channel
+ * @note
+ *	The RTCC keeps counting in EM0 - EM4H, so one compare can wake the Pearl Gecko from
+ *	any sleep mode we use. If the RTCC is already running (a wake-up from EM4H) it is
+ *	not re-initialized, so the time base carries on across hibernation.
+ **/
+void soft_timer_open(void)
+{
+	CMU_ClockEnable(cmuClock_RTCC, true);
+
+	for (int i = 0; i < SOFT_TIMER_COUNT; i++)
+		soft_timers[i].active = false;
+	soft_timer_blocked = false;
+	soft_timer_dirty = false;
+
+	if (!(RTCC -> CTRL & RTCC_CTRL_ENABLE))
+	{
+		RTCC_Init_TypeDef rtcc_init = RTCC_INIT_DEFAULT;
+		rtcc_init.enable = false;
+		rtcc_init.presc = rtccCntPresc_1;
+		RTCC_Init(&rtcc_init);
+	}
+
+	RTCC_CCChConf_TypeDef rtcc_cc = RTCC_CH_INIT_COMPARE_DEFAULT;
+	RTCC_ChannelInit(SOFT_TIMER_CC, &rtcc_cc);
+
+	RTCC -> IFC = RTCC -> IF;
+	RTCC -> IEN = 0;
+	NVIC_EnableIRQ(RTCC_IRQn);
+	RTCC_Enable(true);
+}
+
+/**
+ * @brief
+ *	Starts (or restarts) a soft timer
+ * @details
+ *	The timer expires delay ticks from now and posts event to the scheduler. If period is
+ *	non-zero it then reloads every period ticks, otherwise it stops after one expiry.
+ * @note
+ *	The compare is not reprogrammed here, but by soft_timer_arm() at the end of each pass
+ *	of the main loop (sleep_idle()), so starting / stopping several timers in one pass
+ *	costs one update
+ * @param[in] timer
+ *	timer id, 0 to SOFT_TIMER_COUNT - 1
+ * @param[in] delay
+ *	ticks until the first expiry, see SOFT_TIMER_MS()
+ * @param[in] period
+ *	ticks between expiries, 0 for a one-shot timer
+ * @param[in] event
+ *	scheduler event id to post on expiry
+ **/
+void soft_timer_start(uint32_t timer, uint32_t delay, uint32_t period, uint32_t event)
+{
+	EFM_ASSERT(timer < SOFT_TIMER_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+
+	soft_timers[timer].deadline = RTCC_CounterGet() + delay;
+	soft_timers[timer].period = period;
+	soft_timers[timer].event = event;
+	soft_timers[timer].active = true;
+	soft_timer_dirty = true;
+
+	CORE_EXIT_CRITICAL();
+}
+
+/**
+ * @brief
+ *	Stops a soft timer
+ * @details
+ *	A stopped timer does not post its event, the RTCC compare moves to the next deadline
+ *	the next time soft_timer_arm() runs, at the end of this pass of the main loop
+ * @param[in] timer
+ *	timer id, 0 to SOFT_TIMER_COUNT - 1
+ **/
+void soft_timer_stop(uint32_t timer)
+{
+	EFM_ASSERT(timer < SOFT_TIMER_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+
+	soft_timers[timer].active = false;
+	soft_timer_dirty = true;
+
+	CORE_EXIT_CRITICAL();
+}
+
+/**
+ * @brief
+ *	Checks if a soft timer is running
+ * @param[in] timer
+ *	timer id, 0 to SOFT_TIMER_COUNT - 1
+ * @returns
+ *	true if the timer has not yet expired (or is periodic)
+ **/
+bool soft_timer_active(uint32_t timer)
+{
+	EFM_ASSERT(timer < SOFT_TIMER_COUNT);
+	return soft_timers[timer].active;
+}
+
+/**
+ * @brief
+ *	Reprograms the RTCC compare, if the timer table changed
+ * @details
+ *	Called by sleep_idle() on every pass of the main loop, whether or not the core then
+ *	sleeps, so the compare always holds the nearest deadline once handlers have run
+ **/
+void soft_timer_arm(void)
+{
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+
+	if (soft_timer_dirty)
+		soft_timer_program();
+
+	CORE_EXIT_CRITICAL();
+}
+
+/**
+ * @brief
+ *	Returns the time until the nearest soft timer deadline
+ * @details
+ *	Used by the sleep manager to pick an energy mode that can wake up in time
+ * @param[out] ticks
+ *	ticks until the nearest deadline, 0 if it is already due
+ * @returns
+ *	true if any soft timer is active, false if there is no deadline
+ **/
+bool soft_timer_next_deadline(uint32_t * ticks)
+{
+	uint32_t nearest;
+	bool any;
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+
+	any = soft_timer_nearest(&nearest);
+	if (any)
+	{
+		uint32_t now = RTCC_CounterGet();
+		*ticks = soft_timer_expired(nearest, now) ? 0 : nearest - now;
+	}
+
+	CORE_EXIT_CRITICAL();
+	return any;
+}
+
+/**
+ * @brief
+ *	Returns the current soft timer time base
+ * @returns
+ *	the free running RTCC counter, in SOFT_TIMER_HZ ticks
+ **/
+uint32_t soft_timer_now(void)
+{
+	return RTCC_CounterGet();
+}
+
+/**
+ * @brief
+ *	Interrupt Routine for the RTCC
+ *
+ * @details
+ *	Posts the event of every expired soft timer, reloads periodic timers, then programs the
+ *	compare for the next deadline
+ *
+ * @note
+ *	A periodic timer that fell more than a period behind is reloaded from now, rather than
+ *	posting a burst of catch-up events
+ **/
+void RTCC_IRQHandler(void)
+{
+	__disable_irq();
+
+	uint32_t int_flag = RTCC -> IF & RTCC -> IEN;
+	RTCC -> IFC = int_flag;
+
+	if (int_flag & SOFT_TIMER_IF)
+	{
+		uint32_t now = RTCC_CounterGet();
+		for (int i = 0; i < SOFT_TIMER_COUNT; i++)
+		{
+			if (soft_timers[i].active && soft_timer_expired(soft_timers[i].deadline, now))
+			{
+				add_scheduled_event(soft_timers[i].event);
+				if (soft_timers[i].period)
+				{
+					soft_timers[i].deadline += soft_timers[i].period;
+					if (soft_timer_expired(soft_timers[i].deadline, now))
+						soft_timers[i].deadline = now + soft_timers[i].period;
+				}
+				else
+					soft_timers[i].active = false;
+			}
+		}
+		soft_timer_program();
+	}
+
+	__enable_irq();
+}
@@ -38,7 +38,7 @@
  * @brief
  * 	main function for our application
  * @details
- *  opens and starts peripherals, contains scheduler handler
+ *  opens and starts peripherals, dispatches scheduled events (see scheduler_dispatch())
  **/
 int main(void)
 {
@@ -70,26 +70,7 @@ int main(void)
   /* Infinite blink loop */
   while (1)
   {
-	  if (!get_scheduled_events())
-		  enter_sleep();
-
-	  uint32_t events = get_scheduled_events();
-	  if (events)
-	  {
-		  if (events & LETIMER0_UF_EVT)
-			  scheduled_letimer0_uf_evt();
-		  if (events & LETIMER0_COMP0_EVT)
-			  scheduled_letimer0_comp0_evt();
-		  if (events & LETIMER0_COMP1_EVT)
-			  scheduled_letimer0_comp1_evt();
-		  if (events & I2C_SI7021_EVT)
-			  scheduled_i2c_si7021_evt();
-		  if (events & LEUART_RX_DONE_EVT)
-			  scheduled_leuart_rx_done_evt();
-		  if (events & LEUART_TX_DONE_EVT)
-			  scheduled_leuart_tx_done_evt();
-		  if (events & BOOT_UP_EVT)
-			  scheduled_boot_up_evt();
-	  }
+	  sleep_idle();
+	  scheduler_dispatch();
   }
 }
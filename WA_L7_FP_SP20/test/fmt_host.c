@@ -0,0 +1,36 @@
+/**
+ * @file fmt_host.c
+ * @author William Abrams
+ * @date October 16th, 2026
+ * @brief Host runner for fmt_test(), timed against snprintf formatting the same lines
+ */
+
+#include <stdio.h>
+#include "fmt.h"
+
+#define FMT_HOST_RUNS	1000	/**< benchmark runs, the fastest of each is reported **/
+
+/**
+ * @brief
+ *	Runs fmt_test() and fmt_bench_snprintf() FMT_HOST_RUNS times each and reports the
+ *	fastest of both benchmarks
+ * @returns
+ *	0, a failed check exits with 1 from EFM_ASSERT
+ **/
+int main(void)
+{
+	uint32_t best_fmt = UINT32_MAX, best_snprintf = UINT32_MAX;
+
+	for (int i = 0; i < FMT_HOST_RUNS; i++)
+	{
+		uint32_t ns = fmt_test();
+		if (ns < best_fmt)
+			best_fmt = ns;
+		ns = fmt_bench_snprintf();
+		if (ns < best_snprintf)
+			best_snprintf = ns;
+	}
+	printf("fmt_test passed, fmt %u ns, snprintf %u ns/%u lines (best of %u)\n",
+			(unsigned)best_fmt, (unsigned)best_snprintf, FMT_BENCH_LINES, FMT_HOST_RUNS);
+	return 0;
+}
@@ -0,0 +1,13 @@
+/**
+ * @file em_assert.h
+ * @brief Host stand-in for em_assert.h, a failed EFM_ASSERT exits with its location
+ */
+#ifndef EM_ASSERT_H
+#define EM_ASSERT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define EFM_ASSERT(expr)	((expr) ? (void)0 : (fprintf(stderr, "%s:%d: EFM_ASSERT(%s) failed\n", __FILE__, __LINE__, #expr), exit(1)))	/**< prints the failed check and exits **/
+
+#endif /* EM_ASSERT_H */
@@ -0,0 +1,41 @@
+/**
+ * @file em_device.h
+ * @brief Host stand-in for the parts of em_device.h the portable modules use
+ * @details
+ *	DWT -> CYCCNT reads a monotonic nanosecond clock, so on the host the ring_test()
+ *	benchmark reports nanoseconds instead of core cycles
+ */
+#ifndef EM_DEVICE_H
+#define EM_DEVICE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define __DMB()		__sync_synchronize()	/**< full barrier, stands in for the M4 DMB **/
+
+/**
+ * @brief
+ * Host DWT, only the cycle counter
+ **/
+typedef struct
+{
+	uint32_t CYCCNT;	/**< nanoseconds, refreshed on every DWT access **/
+} DWT_Type;
+
+/**
+ * @brief
+ *	Refreshes the host DWT cycle counter from the monotonic clock
+ **/
+static inline DWT_Type * host_dwt(void)
+{
+	static DWT_Type dwt;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	dwt.CYCCNT = (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+	return &dwt;
+}
+
+#define DWT		(host_dwt())	/**< DWT -> CYCCNT is the host time in ns **/
+
+#endif /* EM_DEVICE_H */